@@ -8,6 +8,49 @@
 
 namespace PART_ns {
 
+/*
+ * Keys of a length known at compile time
+ *
+ * The key is compared and hashed as whole words instead of byte by byte.
+ * The fingerprint multiplies the words by an odd constant and keeps the top
+ * bits, so keys which only differ in one byte (e.g. the last byte of big
+ * endian integers in one leaf array) still get different fingerprints. The
+ * tree uses it for every key if it is built with FIXED_KEY_LEN.
+ */
+template <size_t len> struct FixedKey {
+    static bool equal(const void *a, const void *b) {
+        return memcmp(a, b, len) == 0;
+    }
+
+    static uint16_t fingerPrint(const void *k) {
+        uint64_t h = 0;
+        for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+            uint64_t w = 0;
+            memcpy(&w, (const char *)k + i,
+                   len - i < sizeof(w) ? len - i : sizeof(w));
+            h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+        }
+        return h >> 48;
+    }
+};
+
+// a 64-bit key is one integer compare and one multiplication
+template <> struct FixedKey<sizeof(uint64_t)> {
+    static uint64_t word(const void *k) {
+        uint64_t w;
+        memcpy(&w, k, sizeof(w));
+        return w;
+    }
+
+    static bool equal(const void *a, const void *b) {
+        return word(a) == word(b);
+    }
+
+    static uint16_t fingerPrint(const void *k) {
+        return (word(k) * 0x9e3779b97f4a7c15ull) >> 48;
+    }
+};
+
 struct Key {
     uint64_t value;
     size_t key_len;
@@ -78,11 +121,16 @@ inline size_t Key::getKeyLen() const {
 }
 
 inline uint16_t Key::getFingerPrint() const {
+#ifdef FIXED_KEY_LEN
+    assert(key_len == FIXED_KEY_LEN);
+    return FixedKey<FIXED_KEY_LEN>::fingerPrint(fkey);
+#else
     uint16_t re = 0;
     for (int i = 0; i < key_len; i++) {
         re = re * 131 + this->fkey[i];
     }
     return re;
+#endif
 }
 } // namespace PART_ns
 
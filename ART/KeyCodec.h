@@ -0,0 +1,171 @@
+#ifndef ART_KEY_CODEC_H
+#define ART_KEY_CODEC_H
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+namespace PART_ns {
+
+/*
+ * Order-preserving key encoding
+ *
+ * The tree compares keys byte by byte, so typed keys are stored in a form
+ * whose memcmp order is the order of the values:
+ *  - uint64_t is stored big endian
+ *  - int64_t is stored big endian with the sign bit flipped
+ *  - double is stored as its IEEE bits, all bits flipped if negative and
+ *    only the sign bit flipped otherwise (-0.0 sorts before 0.0, NaNs last)
+ *  - a string has every 0x00 escaped as 0x00 0xff and ends with 0x00 0x01,
+ *    so no encoded string is a prefix of another one
+ * A composite key is the concatenation of its fields. The numbers have a
+ * fixed width, thus keys of one schema are never prefixes of each other,
+ * which the tree requires.
+ */
+namespace KeyCodec {
+
+static inline uint64_t order_u64(uint64_t v) { return __builtin_bswap64(v); }
+
+static inline uint64_t order_i64(int64_t v) {
+    return __builtin_bswap64((uint64_t)v ^ (1ull << 63));
+}
+
+static inline uint64_t order_double(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bits ^= (bits >> 63) ? ~0ull : (1ull << 63);
+    return __builtin_bswap64(bits);
+}
+
+// the 8 bytes of an encoded number, e.g. the key of Key::Init
+static inline uint64_t decode_u64(const void *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+static inline int64_t decode_i64(const void *p) {
+    return (int64_t)(decode_u64(p) ^ (1ull << 63));
+}
+
+static inline double decode_double(const void *p) {
+    uint64_t bits = decode_u64(p);
+    bits ^= (bits >> 63) ? (1ull << 63) : ~0ull;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+// appends the fields of a key into a caller buffer, a field which does not
+// fit sets overflow and is dropped
+class Encoder {
+  public:
+    Encoder(uint8_t *buf_, size_t cap_)
+        : buf(buf_), cap(cap_), len(0), overflow(false) {}
+
+    Encoder &u64(uint64_t v) { return number(order_u64(v)); }
+    Encoder &i64(int64_t v) { return number(order_i64(v)); }
+    Encoder &f64(double d) { return number(order_double(d)); }
+
+    Encoder &str(const char *s, size_t n) {
+        size_t need = n + 2;
+        for (size_t i = 0; i < n; i++)
+            need += (s[i] == 0);
+        if (len + need > cap) {
+            overflow = true;
+            return *this;
+        }
+        for (size_t i = 0; i < n; i++) {
+            buf[len++] = (uint8_t)s[i];
+            if (s[i] == 0)
+                buf[len++] = 0xff;
+        }
+        buf[len++] = 0x00;
+        buf[len++] = 0x01;
+        return *this;
+    }
+    Encoder &str(const std::string &s) { return str(s.data(), s.size()); }
+
+    char *data() const { return (char *)buf; }
+    size_t size() const { return len; }
+    bool ok() const { return !overflow; }
+
+  private:
+    Encoder &number(uint64_t ordered) {
+        if (len + sizeof(ordered) > cap) {
+            overflow = true;
+            return *this;
+        }
+        memcpy(buf + len, &ordered, sizeof(ordered));
+        len += sizeof(ordered);
+        return *this;
+    }
+
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+};
+
+// reads the fields back in the order they were encoded, e.g. from
+// Leaf::GetKey() of a scan result. A read past the end or of a malformed
+// string returns false
+class Decoder {
+  public:
+    Decoder(const void *buf_, size_t len_)
+        : buf((const uint8_t *)buf_), len(len_), pos(0) {}
+
+    bool u64(uint64_t &v) {
+        if (pos + sizeof(v) > len)
+            return false;
+        v = decode_u64(buf + pos);
+        pos += sizeof(v);
+        return true;
+    }
+
+    bool i64(int64_t &v) {
+        uint64_t u;
+        if (!u64(u))
+            return false;
+        v = (int64_t)(u ^ (1ull << 63));
+        return true;
+    }
+
+    bool f64(double &d) {
+        if (pos + sizeof(d) > len)
+            return false;
+        d = decode_double(buf + pos);
+        pos += sizeof(d);
+        return true;
+    }
+
+    bool str(std::string &s) {
+        s.clear();
+        while (pos + 1 < len) {
+            uint8_t c = buf[pos++];
+            if (c != 0) {
+                s.push_back((char)c);
+                continue;
+            }
+            uint8_t next = buf[pos++];
+            if (next == 0x01)
+                return true;
+            if (next != 0xff)
+                return false;
+            s.push_back('\0');
+        }
+        return false;
+    }
+
+    bool done() const { return pos == len; }
+
+  private:
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+};
+
+} // namespace KeyCodec
+} // namespace PART_ns
+
+#endif // ART_KEY_CODEC_H
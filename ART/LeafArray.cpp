@@ -68,21 +68,74 @@ bool LeafArray::insert(Leaf *l, bool flush) {
     b.flip();
     auto pos = b._Find_first();
     if (pos < LeafArrayLength) {
-        b.flip();
-        b[pos] = true;
-        bitmap.store(b);
-        auto s =
-            (static_cast<uintptr_t>(l->getFingerPrint()) << FingerPrintShift) |
-            (reinterpret_cast<uintptr_t>(l));
-        leaf[pos].store(s);
-        if (flush)
-            flush_data((void *)&leaf[pos], sizeof(std::atomic<uintptr_t>));
-
+        insertAt(pos, l, flush);
         return true;
     } else {
         return false;
     }
 }
+void LeafArray::insertAt(size_t pos, Leaf *l, bool flush) {
+    auto b = bitmap.load();
+    b[pos] = true;
+    bitmap.store(b);
+    auto s = (static_cast<uintptr_t>(l->getFingerPrint()) << FingerPrintShift) |
+             (reinterpret_cast<uintptr_t>(l));
+    leaf[pos].store(s);
+    if (flush)
+        flush_data((void *)&leaf[pos], sizeof(std::atomic<uintptr_t>));
+}
+#ifdef INLINE_LEAF
+Leaf *LeafArray::insertInline(const Key *k, bool flush) {
+    auto empty = ~bitmap.load();
+    auto pos = (empty & ~inline_retired)._Find_first();
+    if (pos == LeafArrayLength && inline_retired.any() &&
+        inline_retire_epoch < SummarizeGCEpoch()) {
+        // no reader is left from the epochs the areas were retired in
+        inline_retired.reset();
+        pos = empty._Find_first();
+    }
+    if (pos == LeafArrayLength)
+        return nullptr;
+    // the leaf is persisted before it is published in the same slot
+    auto l = new (inline_leaf[pos]) Leaf(k);
+    if (flush)
+        flush_data((void *)l, sizeof(Leaf) + k->key_len + k->val_len);
+    insertAt(pos, l, flush);
+    return l;
+}
+#endif
+bool LeafArray::insertFrom(const LeafArray *from, Leaf *l, bool flush) {
+#ifdef INLINE_LEAF
+    if (from->isInline(l)) {
+        // the arrays filled by a split or a merge are not published yet,
+        // none of their areas is retired
+        auto b = bitmap.load();
+        b.flip();
+        auto pos = b._Find_first();
+        if (pos == LeafArrayLength)
+            return false;
+        size_t size = sizeof(Leaf) + l->key_len + l->val_len;
+        memcpy(inline_leaf[pos], (void *)l, size);
+        if (flush)
+            flush_data((void *)inline_leaf[pos], size);
+        insertAt(pos, reinterpret_cast<Leaf *>(inline_leaf[pos]), flush);
+        return true;
+    }
+#endif
+    return insert(l, flush);
+}
+void LeafArray::retireLeaf(const Leaf *l) {
+#ifdef INLINE_LEAF
+    if (isInline(l)) {
+        auto pos = (reinterpret_cast<const char *>(l) - inline_leaf[0]) /
+                   InlineLeafSize;
+        inline_retired[pos] = true;
+        inline_retire_epoch = Epoch_Mgr::GetGlobalEpoch();
+        return;
+    }
+#endif
+    EpochGuard::DeleteNode((void *)l);
+}
 bool LeafArray::remove(const Key *k) {
     uint16_t finger_print = k->getFingerPrint();
     auto b = bitmap.load();
@@ -97,7 +150,7 @@ bool LeafArray::remove(const Key *k) {
             if (finger_print == thisfp && ptr->checkKey(k)) {
                 leaf[i].store(0);
                 flush_data(&leaf[i], sizeof(std::atomic<uintptr_t>));
-                EpochGuard::DeleteNode(ptr);
+                retireLeaf(ptr);
                 b[i] = false;
                 bitmap.store(b);
                 return true;
@@ -108,6 +161,11 @@ bool LeafArray::remove(const Key *k) {
     return false;
 }
 void LeafArray::reload() {
+#ifdef INLINE_LEAF
+    // the readers of the retired areas are gone with the last run
+    inline_retired.reset();
+    inline_retire_epoch = 0;
+#endif
     auto b = bitmap.load();
     for (int i = 0; i < LeafArrayLength; i++) {
         if (leaf[i].load() != 0) {
@@ -230,7 +288,7 @@ void LeafArray::splitAndUnlock(N *parentNode, uint8_t parentKey,
                 new (alloc_new_node_from_type(NTypes::LeafArray))
                     LeafArray(level);
         }
-        split_array.at(keys[i][level])->insert(getLeafAt(i), false);
+        split_array.at(keys[i][level])->insertFrom(this, getLeafAt(i), false);
     }
 
     N *n;
@@ -276,11 +334,15 @@ std::vector<Leaf *> LeafArray::getSortedLeaf(const Key *start, const Key *end,
                                              bool compare_end) {
     std::vector<Leaf *> leaves;
     auto b = bitmap.load();
-    auto i = b[0] ? 0 : 1;
+    // the first used slot, slots 0 and 1 may both be empty
+    auto i = b[0] ? 0 : b._Find_next(0);
 
     while (i < LeafArrayLength) {
         auto ptr = getLeafAt(i);
         i = b._Find_next(i);
+        // the slot of a concurrent insert or remove can be empty
+        if (ptr == nullptr)
+            continue;
         // start <= ptr < end
         if (compare_start) {
             auto lt_start = leaf_key_lt(ptr, start, start_level);
@@ -304,6 +366,34 @@ std::vector<Leaf *> LeafArray::getSortedLeaf(const Key *start, const Key *end,
 #endif
     return leaves;
 }
+size_t LeafArray::removeRange(const Key *start, const Key *end,
+                              int start_level, bool compare_start,
+                              bool compare_end) {
+    std::vector<Leaf *> removed;
+    auto b = bitmap.load();
+    auto i = b[0] ? 0 : b._Find_next(0);
+
+    while (i < LeafArrayLength) {
+        auto ptr = getLeafAt(i);
+        auto pos = i;
+        i = b._Find_next(i);
+        if (compare_start && leaf_key_lt(ptr, start, start_level))
+            continue;
+        if (compare_end && !leaf_key_lt(ptr, end, start_level))
+            continue;
+        leaf[pos].store(0);
+        b[pos] = false;
+        removed.push_back(ptr);
+    }
+    if (removed.empty())
+        return 0;
+    // the slots are persisted before the leaves become garbage
+    flush_data((void *)leaf, sizeof(leaf));
+    bitmap.store(b);
+    for (Leaf *l : removed)
+        retireLeaf(l);
+    return removed.size();
+}
 bool LeafArray::update(const Key *k, Leaf *l) {
     uint16_t finger_print = k->getFingerPrint();
     auto b = bitmap.load();
@@ -321,6 +411,7 @@ bool LeafArray::update(const Key *k, Leaf *l) {
                 auto news = fingerPrintLeaf(finger_print, l);
                 leaf[i].store(news);
                 flush_data(&leaf[i], sizeof(std::atomic<uintptr_t>));
+                retireLeaf(ptr);
                 return true;
             }
         }
@@ -340,6 +431,7 @@ bool LeafArray::update(const Key *k, Leaf *l) {
                 auto news = fingerPrintLeaf(finger_print, l);
                 leaf[i].store(news);
                 flush_data(&leaf[i], sizeof(std::atomic<uintptr_t>));
+                retireLeaf(ptr);
                 return true;
             }
         }
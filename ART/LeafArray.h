@@ -12,21 +12,47 @@
 namespace PART_ns {
 
 const size_t LeafArrayLength = 64;
+// the leaf arrays under a node are merged when their leaves fit into this,
+// the rest of the merged array is left for inserts before the next split
+const size_t LeafArrayMergeSize = LeafArrayLength / 2;
 const size_t FingerPrintShift = 48;
 
+#ifdef INLINE_LEAF
+#if !defined(LEAF_ARRAY) || !defined(COMPACT_LEAF)
+#error "INLINE_LEAF keeps compact leaves in the leaf arrays"
+#endif
+// a leaf whose header, key and value fit into this is kept in the leaf
+// array, next to the slot pointing to it, e.g. a 16 byte key with an 8 byte
+// value. A larger leaf is allocated outside
+const size_t InlineLeafSize = 32;
+#endif
+
 class LeafArray : public N {
   public:
     std::atomic<uintptr_t> leaf[LeafArrayLength];
     std::atomic<std::bitset<LeafArrayLength>>
         bitmap; // 0 means used slot; 1 means empty slot
+#ifdef INLINE_LEAF
+    // inline_leaf[i] is only used by slot i. A reader may still see the leaf
+    // of a freed slot, so the area stays retired until every epoch entered
+    // before inline_retire_epoch has left. Both are volatile, changed under
+    // the lock of the array and dropped by reload
+    char inline_leaf[LeafArrayLength][InlineLeafSize];
+    std::bitset<LeafArrayLength> inline_retired;
+    uint64_t inline_retire_epoch;
+#endif
 
   public:
     LeafArray(uint32_t level = -1) : N(NTypes::LeafArray, level, {}, 0) {
         bitmap.store(std::bitset<LeafArrayLength>{}.reset());
         memset(leaf, 0, sizeof(leaf));
+#ifdef INLINE_LEAF
+        inline_retired.reset();
+        inline_retire_epoch = 0;
+#endif
     }
 
-    virtual ~LeafArray() {}
+    NODE_DTOR ~LeafArray() {}
 
     size_t getRightmostSetBit() const;
 
@@ -42,10 +68,42 @@ class LeafArray : public N {
 
     Leaf *lookup(const Key *k) const;
 
+    // replace the leaf of k by l and retire the old one
     bool update(const Key *k, Leaf *l);
 
     bool insert(Leaf *l, bool flush);
 
+    // publish l in the empty slot pos
+    void insertAt(size_t pos, Leaf *l, bool flush);
+
+    // true if l is kept in this array, it is freed with the array and not
+    // by EpochGuard::DeleteNode
+    bool isInline(const Leaf *l) const {
+#ifdef INLINE_LEAF
+        auto p = reinterpret_cast<const char *>(l);
+        return p >= inline_leaf[0] && p < inline_leaf[LeafArrayLength];
+#else
+        return false;
+#endif
+    }
+
+#ifdef INLINE_LEAF
+    static bool fitsInline(size_t key_len, size_t val_len) {
+        return sizeof(Leaf) + key_len + val_len <= InlineLeafSize;
+    }
+
+    // build the leaf of k in a free slot whose area is not retired, nullptr
+    // if there is none
+    Leaf *insertInline(const Key *k, bool flush);
+#endif
+
+    // l is no longer published, its area is retired if it is inline,
+    // otherwise it is given to EpochGuard::DeleteNode
+    void retireLeaf(const Leaf *l);
+
+    // insert a leaf of another array, which is copied if it is inline there
+    bool insertFrom(const LeafArray *from, Leaf *l, bool flush);
+
     bool remove(const Key *k);
 
     void reload();
@@ -60,6 +118,11 @@ class LeafArray : public N {
                                       int start_level, bool compare_start,
                                       bool compare_end);
 
+    // remove the leaves getSortedLeaf would return with one flush of the
+    // slots, returns the number of removed leaves
+    size_t removeRange(const Key *start, const Key *end, int start_level,
+                       bool compare_start, bool compare_end);
+
     void graphviz_debug(std::ofstream &f);
 
 } __attribute__((aligned(64)));
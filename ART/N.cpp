@@ -19,12 +19,19 @@ __thread int helpcount = 0;
 int gethelpcount() { return helpcount; }
 
 Leaf::Leaf(const Key *k) : BaseNode(NTypes::Leaf) {
+#ifdef COMPACT_LEAF
+    assert(k->key_len <= UINT16_MAX && k->val_len <= UINT16_MAX);
+    format = CompactLeafFormat;
+#endif
     key_len = k->key_len;
     val_len = k->val_len;
 #ifdef KEY_INLINE
     // have allocate the memory for kv
     memcpy(kv, k->fkey, key_len);
     memcpy(kv + key_len, (void *)k->value, val_len);
+#ifdef COMPACT_LEAF
+    fingerprint = computeFingerPrint();
+#endif
 #else
     // allocate from NVM for variable key
     fkey = new (alloc_new_node_from_size(key_len)) uint8_t[key_len];
@@ -43,11 +50,18 @@ Leaf::Leaf(const Key *k) : BaseNode(NTypes::Leaf) {
 // update value, so no need to alloc key
 Leaf::Leaf(uint8_t *key_, size_t key_len_, char *value_, size_t val_len_)
     : BaseNode(NTypes::Leaf) {
+#ifdef COMPACT_LEAF
+    assert(key_len_ <= UINT16_MAX && val_len_ <= UINT16_MAX);
+    format = CompactLeafFormat;
+#endif
     key_len = key_len_;
     val_len = val_len_;
 #ifdef KEY_INLINE
     memcpy(kv, key_, key_len);
     memcpy(kv + key_len, value_, val_len);
+#ifdef COMPACT_LEAF
+    fingerprint = computeFingerPrint();
+#endif
 #else
     fkey = key_; // no need to alloc a new key, key_ is persistent
     value = new (alloc_new_node_from_size(val_len)) char[val_len];
@@ -55,14 +69,63 @@ Leaf::Leaf(uint8_t *key_, size_t key_len_, char *value_, size_t val_len_)
     flush_data((void *)value, val_len);
 #endif
 }
+bool Leaf::fits(size_t key_len_, size_t val_len_) {
+    if (decltype(key_len)(key_len_) != key_len_ ||
+        decltype(val_len)(val_len_) != val_len_)
+        return false;
+#if defined(KEY_INLINE) && defined(ARTPMDK)
+    return true;
+#elif defined(KEY_INLINE)
+    return sizeof(Leaf) + key_len_ + val_len_ <= max_alloc_size;
+#else
+    return key_len_ <= max_alloc_size && val_len_ <= max_alloc_size;
+#endif
+}
+
 uint16_t Leaf::getFingerPrint() {
+#ifdef COMPACT_LEAF
+    return fingerprint;
+#else
+    return computeFingerPrint();
+#endif
+}
+
+uint16_t Leaf::computeFingerPrint() {
+#ifdef FIXED_KEY_LEN
+    return FixedKey<FIXED_KEY_LEN>::fingerPrint(GetKey());
+#else
     uint16_t re = 0;
-    auto k = GetKey();
+    // the same bytes as Key::getFingerPrint, char is signed
+    auto k = reinterpret_cast<uint8_t *>(GetKey());
     for (int i = 0; i < key_len; i++) {
         re = re * 131 + k[i];
     }
     return re;
+#endif
+}
+#ifdef INPLACE_UPDATE
+// The value is spliced into the aligned word which holds it, the word is
+// written by one 8 byte store and flushed. Both NVM and readers see the old
+// or the new value, never a mix, and the bytes around the value in the word
+// (key or unused space of the leaf) are written back unchanged. Writers of a
+// leaf are serialized by the lock of its parent.
+bool Leaf::updateInPlace(const Key *k) {
+    if (k->val_len != val_len || val_len > sizeof(uint64_t))
+        return false;
+    uintptr_t addr = reinterpret_cast<uintptr_t>(GetValue());
+    uintptr_t word = addr & ~(uintptr_t)(sizeof(uint64_t) - 1);
+    if (addr + val_len > word + sizeof(uint64_t))
+        return false;
+
+    auto *w = reinterpret_cast<std::atomic<uint64_t> *>(word);
+    uint64_t v = w->load();
+    memcpy((char *)&v + (addr - word), (void *)k->value, val_len);
+    w->store(v);
+    flush_data((void *)word, sizeof(uint64_t));
+    return true;
 }
+#endif
+
 void Leaf::graphviz_debug(std::ofstream &f) {
     char buf[1000] = {};
     sprintf(buf + strlen(buf), "node%lx [label=\"",
@@ -90,8 +153,10 @@ void N::helpFlush(std::atomic<N *> *n) {
     if (n == nullptr)
         return;
     N *now_node = n->load();
+    COUNT_PERSIST_EVENT(help_flush, 1);
     // printf("help\n");
     if (N::isDirty(now_node)) {
+        helpcount++;
         //        printf("help, point to type is %d\n",
         //               ((BaseNode *)N::clearDirty(now_node))->type);
         flush_data((void *)n, sizeof(N *));
@@ -117,12 +182,14 @@ void N::check_generation() {
     //    }
     uint64_t mgr_generation = get_threadlocal_generation();
 
-    uint64_t zero = 0;
-    uint64_t one = 1;
     if (generation_version != mgr_generation) {
         //        printf("start to recovery of this node %lld\n",
         //        (uint64_t)this);
-        if (recovery_latch.compare_exchange_strong(zero, one)) {
+        // the latch keeps the generation which repairs this node, so a latch
+        // left by a crash during the last recovery can still be taken
+        uint64_t latch = recovery_latch.load();
+        if (latch != mgr_generation &&
+            recovery_latch.compare_exchange_strong(latch, mgr_generation)) {
             //            printf("start to recovery of this node %lld\n",
             //            (uint64_t)this);
             type_version_lock_obsolete = new std::atomic<uint64_t>;
@@ -140,13 +207,13 @@ void N::check_generation() {
 #ifdef ZENTRY
                     if (n->zens[i].load() != 0) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #else
                     N *child = n->children[i].load();
                     if (child != nullptr) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #endif
                 }
@@ -158,13 +225,13 @@ void N::check_generation() {
 #ifdef ZENTRY
                     if (n->zens[i].load() != 0) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #else
                     N *child = n->children[i].load();
                     if (child != nullptr) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #endif
                 }
@@ -178,13 +245,13 @@ void N::check_generation() {
                     if (p.second != nullptr) {
                         n->childIndex[p.first] = i;
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #else
                     N *child = n->children[i].load();
                     if (child != nullptr) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
 #endif
                 }
@@ -196,7 +263,7 @@ void N::check_generation() {
                     N *child = n->children[i].load();
                     if (child != nullptr) {
                         count++;
-                        compactCount = i;
+                        compactCount = i + 1;
                     }
                 }
                 break;
@@ -214,10 +281,20 @@ void N::check_generation() {
 
             generation_version = mgr_generation;
             flush_data(&generation_version, sizeof(uint64_t));
-            recovery_latch.store(zero);
 
         } else {
-            while (generation_version != mgr_generation) {
+            // another thread is repairing this node, back off instead of
+            // spinning on the cache line it is writing
+            int backoff = 1;
+            while (*(volatile uint64_t *)&generation_version !=
+                   mgr_generation) {
+                if (backoff < 1024) {
+                    for (int i = 0; i < backoff; i++)
+                        _mm_pause();
+                    backoff <<= 1;
+                } else {
+                    std::this_thread::yield();
+                }
             }
         }
     }
@@ -758,6 +835,82 @@ void N::deleteNode(N *node) {
     delete node;
 }
 
+bool N::lockSubtree(N *node, std::vector<N *> &locked) {
+#ifdef LEAF_ARRAY
+    N *n = isLeafArray(node) ? getLeafArray(node) : node;
+#else
+    if (isLeaf(node))
+        return true;
+    N *n = node;
+#endif
+    bool needRestart = false;
+    uint64_t v = n->getVersion();
+    n->lockVersionOrRestart(v, needRestart);
+    if (needRestart)
+        return false;
+    locked.push_back(n);
+#ifdef LEAF_ARRAY
+    if (isLeafArray(node))
+        return true;
+#endif
+
+    std::tuple<uint8_t, N *> children[256];
+    uint32_t childrenCount = 0;
+    getChildren(n, 0u, 255u, children, childrenCount);
+    for (uint32_t i = 0; i < childrenCount; ++i) {
+        if (!lockSubtree(std::get<1>(children[i]), locked))
+            return false;
+    }
+    return true;
+}
+
+// the number of leaves below node
+static size_t countLeaves(N *node) {
+#ifdef LEAF_ARRAY
+    if (N::isLeafArray(node))
+        return N::getLeafArray(node)->getCount();
+#else
+    if (N::isLeaf(node))
+        return 1;
+#endif
+    std::tuple<uint8_t, N *> children[256];
+    uint32_t childrenCount = 0;
+    N::getChildren(node, 0u, 255u, children, childrenCount);
+    size_t leaves = 0;
+    for (uint32_t i = 0; i < childrenCount; ++i)
+        leaves += countLeaves(std::get<1>(children[i]));
+    return leaves;
+}
+
+size_t N::retireSubtree(N *node) {
+    size_t leaves = countLeaves(node);
+    // one garbage entry for the whole subtree, however large it is; a leaf
+    // array or a leaf is untagged, it is told apart by its type
+    if (isLeaf(node))
+        node = (N *)getLeaf(node);
+    EpochGuard::DeleteSubtree((void *)node);
+    return leaves;
+}
+
+#ifdef LEAF_ARRAY
+// the first leaf below node, nullptr if all of its leaf arrays are empty
+static Leaf *findAnyLeaf(N *node) {
+    if (N::isLeafArray(node)) {
+        N *leaf = N::getLeafArray(node)->getAnyChild();
+        return leaf == nullptr ? nullptr : N::getLeaf(leaf);
+    }
+    std::tuple<uint8_t, N *> children[256];
+    uint32_t childrenCount = 0;
+    N::getChildren(node, 0u, 255u, children, childrenCount);
+    for (uint32_t i = 0; i < childrenCount; ++i) {
+        Leaf *leaf = findAnyLeaf(std::get<1>(children[i]));
+        if (leaf != nullptr)
+            return leaf;
+    }
+    return nullptr;
+}
+#endif
+
 // invoke in the insert
 // not all nodes are in the critical secton
 Leaf *N::getAnyChildTid(const N *n) {
@@ -769,6 +922,13 @@ Leaf *N::getAnyChildTid(const N *n) {
 
         assert(nextNode != nullptr);
         if (isLeaf(nextNode)) {
+#ifdef LEAF_ARRAY
+            // a leaf array is tagged in the same way as a leaf, and may be
+            // emptied by removals
+            nextNode = getLeafArray(nextNode)->getAnyChild();
+            if (nextNode == nullptr)
+                return findAnyLeaf(const_cast<N *>(n));
+#endif
             return getLeaf(nextNode);
         }
     }
@@ -866,7 +1026,7 @@ void N::rebuild_node(N *node, std::vector<std::pair<uint64_t, size_t>> &rs,
 #endif
             if (child != nullptr) {
                 xcount++;
-                xcompactCount = i;
+                xcompactCount = i + 1;
                 rebuild_node(child, rs, start_addr, end_addr, thread_id);
             }
         }
@@ -882,7 +1042,7 @@ void N::rebuild_node(N *node, std::vector<std::pair<uint64_t, size_t>> &rs,
 #endif
             if (child != nullptr) {
                 xcount++;
-                xcompactCount = i;
+                xcompactCount = i + 1;
                 rebuild_node(child, rs, start_addr, end_addr, thread_id);
             }
         }
@@ -898,7 +1058,7 @@ void N::rebuild_node(N *node, std::vector<std::pair<uint64_t, size_t>> &rs,
 #endif
             if (child != nullptr) {
                 xcount++;
-                xcompactCount = i;
+                xcompactCount = i + 1;
                 rebuild_node(child, rs, start_addr, end_addr, thread_id);
             }
         }
@@ -910,7 +1070,7 @@ void N::rebuild_node(N *node, std::vector<std::pair<uint64_t, size_t>> &rs,
             N *child = n->children[i].load();
             if (child != nullptr) {
                 xcount++;
-                xcompactCount = i;
+                xcompactCount = i + 1;
                 rebuild_node(child, rs, start_addr, end_addr, thread_id);
             }
         }
@@ -1004,7 +1164,8 @@ bool N::key_keylen_lt(char *a, const int alen, char *b, const int blen,
                       const int compare_level) {
     for (int i = compare_level; i < std::min(alen, blen); i++) {
         if (a[i] != b[i]) {
-            return a[i] < b[i];
+            // the tree orders unsigned bytes, char is signed
+            return (uint8_t)a[i] < (uint8_t)b[i];
         }
     }
     return alen < blen;
@@ -24,17 +24,45 @@ enum class NTypes : uint8_t {
 
 class LeafArray;
 
+#ifdef COMPACT_LEAF
+#ifndef KEY_INLINE
+#error "COMPACT_LEAF stores the key and value in the leaf, it needs KEY_INLINE"
+#endif
+// No persistent node carries a vtable pointer, which is invalid after a
+// restart anyway, so type is the first byte of every node and leaf and the
+// epoch GC tells them apart as before
+#define NODE_DTOR
+#define LEAF_ALIGN
+#else
+#define NODE_DTOR virtual
+#define LEAF_ALIGN __attribute__((aligned(64)))
+#endif
+
 class BaseNode {
   public:
     NTypes type;
     BaseNode(NTypes type_) : type(type_) {}
-    virtual ~BaseNode() {}
+    NODE_DTOR ~BaseNode() {}
 };
 
+#ifdef COMPACT_LEAF
+// the format byte of a compact leaf, bumped whenever its layout changes
+static constexpr uint8_t CompactLeafFormat = 1;
+#endif
+
 class Leaf : public BaseNode {
   public:
+#ifdef COMPACT_LEAF
+    // an 8 byte header before the key and the value, which are at most
+    // 64KB each: type, format, lengths and the fingerprint of the key
+    uint8_t format;
+    uint16_t key_len;
+    uint16_t val_len;
+    uint16_t fingerprint;
+#else
     size_t key_len;
     size_t val_len;
+#endif
 //    uint64_t key;
 // variable key
 #ifdef KEY_INLINE
@@ -51,10 +79,15 @@ class Leaf : public BaseNode {
     // use for test
     Leaf() : BaseNode(NTypes::Leaf) {}
 
-    virtual ~Leaf() {}
+    NODE_DTOR ~Leaf() {}
 
     bool checkKey(const Key *k) const {
-#ifdef KEY_INLINE
+#if defined(FIXED_KEY_LEN) && defined(KEY_INLINE)
+        // the key is the first FIXED_KEY_LEN bytes of kv
+        return FixedKey<FIXED_KEY_LEN>::equal(kv, k->fkey);
+#elif defined(FIXED_KEY_LEN)
+        return FixedKey<FIXED_KEY_LEN>::equal(fkey, k->fkey);
+#elif defined(KEY_INLINE)
         if (key_len == k->getKeyLen() && memcmp(kv, k->fkey, key_len) == 0)
             return true;
         return false;
@@ -65,6 +98,8 @@ class Leaf : public BaseNode {
 #endif
     }
     size_t getKeyLen() const { return key_len; }
+    // whether a key and a value of these lengths fit into a leaf
+    static bool fits(size_t key_len_, size_t val_len_);
     char *GetKey() {
 #ifdef KEY_INLINE
         return kv;
@@ -82,9 +117,22 @@ class Leaf : public BaseNode {
 
     uint16_t getFingerPrint();
 
+    // the fingerprint of the key bytes, as Key::getFingerPrint
+    uint16_t computeFingerPrint();
+
+#ifdef INPLACE_UPDATE
+    // overwrite the value of at most 8 bytes with a single atomic store,
+    // false if the new value has another length or spans two words
+    bool updateInPlace(const Key *k);
+#endif
+
     void graphviz_debug(std::ofstream &f);
 
-} __attribute__((aligned(64)));
+} LEAF_ALIGN;
+
+#ifdef COMPACT_LEAF
+static_assert(sizeof(Leaf) == 8, "the compact leaf header is 8 bytes");
+#endif
 
 static constexpr uint32_t maxStoredPrefixLength = 4;
 struct Prefix {
@@ -116,7 +164,7 @@ class N : public BaseNode {
 
     N(N &&) = delete;
 
-    virtual ~N() {}
+    NODE_DTOR ~N() {}
 
     // 3b type 59b version 1b lock 1b obsolete
     // obsolete means this node has been deleted
@@ -214,12 +262,22 @@ class N : public BaseNode {
 
     static N *getAnyChild(N *n);
 
+    // nullptr if every leaf array below n is empty
     static Leaf *getAnyChildTid(const N *n);
 
     static void deleteChildren(N *node);
 
     static void deleteNode(N *node);
 
+    // write lock node and every node below it top down without waiting,
+    // false if one of them is locked or obsolete; locked collects the nodes
+    // locked so far, which the caller unlocks
+    static bool lockSubtree(N *node, std::vector<N *> &locked);
+
+    // hand an unlinked subtree and its leaves to the epoch GC as one garbage
+    // entry, returns the number of leaves
+    static size_t retireSubtree(N *node);
+
     static std::tuple<N *, uint8_t> getSecondChild(N *node, const uint8_t k);
 
     template <typename curN, typename biggerN>
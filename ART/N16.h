@@ -64,7 +64,7 @@ class N16 : public N {
 #endif
     }
 
-    virtual ~N16() {}
+    NODE_DTOR ~N16() {}
 
     bool insert(uint8_t key, N *n, bool flush);
 
@@ -18,7 +18,7 @@ class N256 : public N {
         memset(children, '\0', sizeof(children));
     }
 
-    virtual ~N256() {}
+    NODE_DTOR ~N256() {}
 
     bool insert(uint8_t key, N *val, bool flush);
 
@@ -32,7 +32,7 @@ class N4 : public N {
 #endif
     }
 
-    virtual ~N4() {}
+    NODE_DTOR ~N4() {}
 
     bool insert(uint8_t key, N *n, bool flush);
 
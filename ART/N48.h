@@ -34,7 +34,7 @@ class N48 : public N {
 #endif
     }
 
-    virtual ~N48() {}
+    NODE_DTOR ~N48() {}
 
     bool insert(uint8_t key, N *n, bool flush);
 
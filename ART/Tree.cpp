@@ -51,6 +51,13 @@ void *allocate_size(size_t size) {
 
 Tree::Tree() {
     std::cout << "[P-ART]\tnew P-ART\n";
+#ifdef INSTANT_RESTART
+    recovering.store(false);
+    for (int i = 0; i < 256; i++) {
+        heat[i].store(0);
+        claimed[i].store(false);
+    }
+#endif
 
     init_nvm_mgr();
     register_threadinfo();
@@ -108,6 +115,9 @@ Tree::~Tree() {
     //    N::deleteChildren(root);
     //    N::deleteNode(root);
     std::cout << "[P-ART]\tshut down, free the tree\n";
+#ifdef INSTANT_RESTART
+    waitRecovery();
+#endif
     unregister_threadinfo();
     close_nvm_mgr();
 }
@@ -135,10 +145,30 @@ Leaf *Tree::allocLeaf(const Key *k) const {
     return newLeaf;
 #endif
 }
+
+#ifdef LEAF_ARRAY
+// put the leaf of k into la, which is locked or not published and not full
+Leaf *Tree::addLeaf(LeafArray *la, const Key *k) const {
+#ifdef INLINE_LEAF
+    if (LeafArray::fitsInline(k->key_len, k->val_len)) {
+        // the free slots may all have retired areas
+        Leaf *leaf = la->insertInline(k, true);
+        if (leaf != nullptr)
+            return leaf;
+    }
+#endif
+    Leaf *leaf = allocLeaf(k);
+    la->insert(leaf, true);
+    return leaf;
+}
+#endif
 #ifdef LEAF_ARRAY
 Leaf *Tree::lookup(const Key *k) const {
     // enter a new epoch
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
     bool need_restart;
     int restart_cnt = 0;
 restart:
@@ -201,6 +231,9 @@ restart:
 Leaf *Tree::lookup(const Key *k) const {
     // enter a new epoch
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
 
     N *node = root;
 
@@ -260,7 +293,12 @@ int get_count() { return checkcount; }
 #endif
 
 typename Tree::OperationResults Tree::update(const Key *k) const {
+    if (!Leaf::fits(k->key_len, k->val_len))
+        return OperationResults::UnSuccess;
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
 restart:
     bool needRestart = false;
 
@@ -310,9 +348,32 @@ restart:
                     goto restart;
                 }
 
+                // inserts and removes only lock the leaf array, they free
+                // and reuse the slots and the inline leaves written here
                 auto *leaf_array = N::getLeafArray(nextNode);
+                auto lav = leaf_array->getVersion();
+                leaf_array->lockVersionOrRestart(lav, needRestart);
+                if (needRestart) {
+                    node->writeUnlock();
+                    goto restart;
+                }
+#ifdef INPLACE_UPDATE
+                // no leaf is allocated for a missing key or a small value
+                Leaf *old = leaf_array->lookup(k);
+                if (old == nullptr) {
+                    leaf_array->writeUnlock();
+                    node->writeUnlock();
+                    return OperationResults::NotFound;
+                }
+                if (old->updateInPlace(k)) {
+                    leaf_array->writeUnlock();
+                    node->writeUnlock();
+                    return OperationResults::Success;
+                }
+#endif
                 auto leaf = allocLeaf(k);
                 auto result = leaf_array->update(k, leaf);
+                leaf_array->writeUnlock();
                 node->writeUnlock();
                 if (!result) {
                     EpochGuard::DeleteNode(leaf);
@@ -334,11 +395,18 @@ restart:
                     node->writeUnlock();
                     return OperationResults::NotFound;
                 }
+#ifdef INPLACE_UPDATE
+                if (leaf->updateInPlace(k)) {
+                    node->writeUnlock();
+                    return OperationResults::Success;
+                }
+#endif
                 //
                 Leaf *newleaf = allocLeaf(k);
                 //
                 N::change(node, nodeKey, N::setLeaf(newleaf));
                 node->writeUnlock();
+                EpochGuard::DeleteNode((void *)leaf);
                 return OperationResults::Success;
             }
 #endif
@@ -367,6 +435,9 @@ bool Tree::lookupRange(const Key *start, const Key *end, const Key *continueKey,
     //    }
     char scan_value[100];
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(start);
+#endif
 
     Leaf *toContinue = nullptr;
     bool restart;
@@ -595,6 +666,9 @@ bool Tree::lookupRange(const Key *start, const Key *end, const Key *continueKey,
     char scan_value[100];
     // enter a new epoch
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(start);
+#endif
 
     Leaf *toContinue = nullptr;
     bool restart;
@@ -791,13 +865,300 @@ restart:
     }
 }
 #endif
+// Descend along the bytes of the prefix, comparing compressed prefixes as
+// checkPrefixCompare does. Once the prefix is used up, every key below the
+// node starts with it and the subtree is streamed without bound checks,
+// only a leaf (array) reached before the end of the prefix compares the
+// rest of the prefix with its keys.
+std::size_t Tree::scanPrefix(const Key *prefix, const Visitor &visit) const {
+    EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(prefix);
+#endif
+    const uint32_t prefix_len = prefix->getKeyLen();
+    std::size_t visited = 0;
+    bool stop = false;
+
+    // the keys below level agree with the prefix
+    auto emit = [&](Leaf *leaf, uint32_t level) {
+        if (level < prefix_len &&
+            (leaf->key_len < prefix_len ||
+             memcmp(leaf->GetKey() + level, prefix->fkey + level,
+                    prefix_len - level) != 0))
+            return;
+        visited++;
+        stop = !visit(leaf);
+    };
+
+    // a leaf and a leaf array have the same tag, the build decides which
+    std::function<void(N *, uint32_t)> stream = [&](N *node, uint32_t level) {
+#ifndef LEAF_ARRAY
+        if (N::isLeaf(node)) {
+            emit(N::getLeaf(node), level);
+            return;
+        }
+#else
+        if (N::isLeafArray(node)) {
+#ifdef INSTANT_RESTART
+            N::getLeafArray(node)->check_generation();
+#endif
+            auto leaves = N::getLeafArray(node)->getSortedLeaf(
+                nullptr, nullptr, level, false, false);
+            std::sort(leaves.begin(), leaves.end(),
+                      [level](Leaf *a, Leaf *b) {
+                          return N::leaf_lt(a, b, level);
+                      });
+            for (Leaf *leaf : leaves) {
+                emit(leaf, level);
+                if (stop)
+                    return;
+            }
+            return;
+        }
+#endif
+#ifdef INSTANT_RESTART
+        node->check_generation();
+#endif
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount && !stop; ++i)
+            stream(std::get<1>(children[i]), node->getLevel() + 1);
+    };
+
+restart:
+    N *node = root;
+    uint32_t level = 0;
+
+    while (true) {
+        if (N::isLeaf(node)) {
+            stream(node, level);
+            return visited;
+        }
+#ifdef INSTANT_RESTART
+        node->check_generation();
+#endif
+        Prefix p = node->getPrefi();
+        if (p.prefixCount + level < node->getLevel())
+            goto restart; // a concurrent split of the prefix
+        Leaf *kt = nullptr;
+        for (uint32_t i = (level + p.prefixCount) - node->getLevel();
+             i < p.prefixCount && level < prefix_len; ++i, ++level) {
+            if (i >= maxStoredPrefixLength && kt == nullptr) {
+                kt = N::getAnyChildTid(node);
+                if (kt == nullptr)
+                    return 0; // all leaf arrays below node are empty
+            }
+            uint8_t cur = i >= maxStoredPrefixLength
+                              ? (uint8_t)kt->GetKey()[level]
+                              : p.prefix[i];
+            if (cur != prefix->fkey[level])
+                return 0;
+        }
+        if (level >= prefix_len) {
+            stream(node, level);
+            return visited;
+        }
+
+        N *next = N::getChild(prefix->fkey[level], node);
+        if (next == nullptr)
+            return 0;
+        node = next;
+        level++;
+    }
+}
+
+// A bound which differs in the compressed prefix of node either excludes
+// the node or stops to matter below it, and a bound which ends above the
+// node is a prefix of its keys. level becomes the level of node.
+bool Tree::narrowRange(const N *node, const Key *start, const Key *end,
+                       uint32_t &level, bool &compare_start,
+                       bool &compare_end, uint8_t &startLevel,
+                       uint8_t &endLevel, bool &restart) {
+    uint32_t prefixLevel = level;
+    if (compare_end) {
+        switch (checkPrefixCompare(node, end, prefixLevel)) {
+        case PCCompareResults::Bigger:
+            return false;
+        case PCCompareResults::Smaller:
+            compare_end = false;
+            break;
+        case PCCompareResults::SkippedLevel:
+            restart = true;
+            return false;
+        case PCCompareResults::Equal:
+            break;
+        }
+    }
+    prefixLevel = level;
+    if (compare_start) {
+        switch (checkPrefixCompare(node, start, prefixLevel)) {
+        case PCCompareResults::Smaller:
+            return false;
+        case PCCompareResults::Bigger:
+            compare_start = false;
+            break;
+        case PCCompareResults::SkippedLevel:
+            restart = true;
+            return false;
+        case PCCompareResults::Equal:
+            break;
+        }
+    }
+
+    level = node->getLevel();
+    if (compare_end && end->getKeyLen() <= level)
+        return false;
+    if (compare_start && start->getKeyLen() <= level)
+        compare_start = false;
+    startLevel = compare_start ? start->fkey[level] : 0;
+    endLevel = compare_end ? end->fkey[level] : 255;
+    return startLevel <= endLevel;
+}
+
+// The mirror of lookupRange: the children of a node are visited from the
+// largest byte down, and only the subtrees on the path of a bound compare
+// keys with it. The scan stops at the first leaf which does not fit into
+// result, so the last N keys cost N leaves and one path per bound.
+bool Tree::scanReverse(const Key *start, const Key *end, bool endInclusive,
+                       Leaf *result[], std::size_t resultLen,
+                       std::size_t &resultCount, std::string *lastKey) const {
+    resultCount = 0;
+    if (start != nullptr && end != nullptr &&
+        (endInclusive ? N::key_key_lt(end, start)
+                      : !N::key_key_lt(start, end)))
+        return false;
+    EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    if (end != nullptr)
+        touch(end);
+#endif
+    bool full = false;
+    bool restart = false;
+
+    // the candidates of one leaf (array), which are >= start already
+    auto take = [&](std::vector<Leaf *> &leaves, uint32_t level,
+                    bool compare_end) {
+        if (compare_end) {
+            leaves.erase(std::remove_if(leaves.begin(), leaves.end(),
+                                        [&](Leaf *leaf) {
+                                            return endInclusive
+                                                       ? N::key_leaf_lt(
+                                                             end, leaf, level)
+                                                       : !N::leaf_key_lt(
+                                                             leaf, end, level);
+                                        }),
+                         leaves.end());
+        }
+        std::sort(leaves.begin(), leaves.end(), [level](Leaf *a, Leaf *b) {
+            return N::leaf_lt(b, a, level);
+        });
+        for (Leaf *leaf : leaves) {
+            if (resultCount == resultLen) {
+                full = true;
+                return;
+            }
+            result[resultCount++] = leaf;
+        }
+    };
+
+    std::function<void(N *, uint32_t, bool, bool)> visit =
+        [&](N *node, uint32_t level, bool compare_start, bool compare_end) {
+            // a leaf and a leaf array have the same tag, the build decides
+#ifdef LEAF_ARRAY
+            if (N::isLeafArray(node)) {
+                auto leaves = N::getLeafArray(node)->getSortedLeaf(
+                    start, nullptr, level, compare_start, false);
+                take(leaves, level, compare_end);
+                return;
+            }
+#else
+            if (N::isLeaf(node)) {
+                std::vector<Leaf *> leaves;
+                Leaf *leaf = N::getLeaf(node);
+                if (!compare_start || !N::leaf_key_lt(leaf, start, level))
+                    leaves.push_back(leaf);
+                take(leaves, level, compare_end);
+                return;
+            }
+#endif
+#ifdef INSTANT_RESTART
+            node->check_generation();
+#endif
+            uint8_t startLevel, endLevel;
+            if (!narrowRange(node, start, end, level, compare_start,
+                             compare_end, startLevel, endLevel, restart))
+                return;
+
+            std::tuple<uint8_t, N *> children[256];
+            uint32_t childrenCount = 0;
+            N::getChildren(node, startLevel, endLevel, children,
+                           childrenCount);
+            for (uint32_t i = childrenCount; i-- > 0 && !full && !restart;) {
+                const uint8_t k = std::get<0>(children[i]);
+                visit(std::get<1>(children[i]), level + 1,
+                      compare_start && k == startLevel,
+                      compare_end && k == endLevel);
+            }
+        };
+
+    while (true) {
+        visit(root, 0, start != nullptr, end != nullptr);
+        if (!restart)
+            break;
+        restart = full = false;
+        resultCount = 0;
+    }
+    if (lastKey != nullptr && resultCount > 0) {
+        Leaf *leaf = result[resultCount - 1];
+        lastKey->assign(leaf->GetKey(), leaf->key_len);
+    }
+    return full;
+}
+
+bool Tree::lookupRangeReverse(const Key *start, const Key *end,
+                              Leaf *result[], std::size_t resultLen,
+                              std::size_t &resultCount) const {
+    return scanReverse(start, end, false, result, resultLen, resultCount);
+}
+
+Tree::ReverseIterator::ReverseIterator(const Tree *tree_, std::size_t batch)
+    : tree(tree_), buf(batch > 0 ? batch : 1), pos(0), count(0),
+      more(false) {}
+
+void Tree::ReverseIterator::fill(const Key *bound, bool inclusive) {
+    more = tree->scanReverse(nullptr, bound, inclusive, buf.data(), buf.size(),
+                             count, &last);
+    pos = 0;
+}
+
+void Tree::ReverseIterator::seekForPrev(const Key *k) { fill(k, true); }
+
+void Tree::ReverseIterator::seekToLast() { fill(nullptr, false); }
+
+void Tree::ReverseIterator::prev() {
+    if (++pos < count || !more)
+        return;
+    // continue below the smallest key of the batch, fill overwrites last
+    std::string bound;
+    bound.swap(last);
+    Key k;
+    k.Init((char *)bound.data(), bound.size(), nullptr, 0);
+    fill(&k, false);
+}
+
 bool Tree::checkKey(const Key *ret, const Key *k) const {
     return ret->getKeyLen() == k->getKeyLen() &&
            memcmp(ret->fkey, k->fkey, k->getKeyLen()) == 0;
 }
 
 typename Tree::OperationResults Tree::insert(const Key *k) {
+    if (!Leaf::fits(k->key_len, k->val_len))
+        return OperationResults::UnSuccess;
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
 
 restart:
     bool needRestart = false;
@@ -825,6 +1186,11 @@ restart:
                                    remainingPrefix)) { // increases nextLevel
         case CheckPrefixPessimisticResult::SkippedLevel:
             goto restart;
+#ifdef LEAF_ARRAY
+        case CheckPrefixPessimisticResult::Empty:
+            dropEmptySubtree(node, parentNode, parentKey);
+            goto restart;
+#endif
         case CheckPrefixPessimisticResult::NoMatch: {
             assert(nextLevel < k->getKeyLen()); // prevent duplicate key
             node->lockVersionOrRestart(v, needRestart);
@@ -845,15 +1211,14 @@ restart:
 
             // 2)  add node and (tid, *k) as children
 
-            auto *newLeaf = allocLeaf(k);
-
 #ifdef LEAF_ARRAY
             auto newLeafArray =
                 new (alloc_new_node_from_type(NTypes::LeafArray)) LeafArray();
-            newLeafArray->insert(newLeaf, true);
+            auto *newLeaf = addLeaf(newLeafArray, k);
             newNode->insert(k->fkey[nextLevel], N::setLeafArray(newLeafArray),
                             false);
 #else
+            auto *newLeaf = allocLeaf(k);
             newNode->insert(k->fkey[nextLevel], N::setLeaf(newLeaf), false);
 #endif
             // not persist
@@ -867,9 +1232,12 @@ restart:
             if (needRestart) {
                 EpochGuard::DeleteNode((void *)newNode);
 #ifdef LEAF_ARRAY
+                if (!newLeafArray->isInline(newLeaf))
+                    EpochGuard::DeleteNode((void *)newLeaf);
                 EpochGuard::DeleteNode(newLeafArray);
-#endif
+#else
                 EpochGuard::DeleteNode((void *)newLeaf);
+#endif
 
                 node->writeUnlock();
                 goto restart;
@@ -904,14 +1272,14 @@ restart:
             node->lockVersionOrRestart(v, needRestart);
             if (needRestart)
                 goto restart;
-            Leaf *newLeaf = allocLeaf(k);
 #ifdef LEAF_ARRAY
             auto newLeafArray =
                 new (alloc_new_node_from_type(NTypes::LeafArray)) LeafArray();
-            newLeafArray->insert(newLeaf, true);
+            addLeaf(newLeafArray, k);
             N::insertAndUnlock(node, parentNode, parentKey, nodeKey,
                                N::setLeafArray(newLeafArray), needRestart);
 #else
+            Leaf *newLeaf = allocLeaf(k);
             N::insertAndUnlock(node, parentNode, parentKey, nodeKey,
                                N::setLeaf(newLeaf), needRestart);
 #endif
@@ -939,8 +1307,7 @@ restart:
                     nextNode = N::getChild(nodeKey, node);
                     // insert at the next iteration
                 } else {
-                    auto leaf = allocLeaf(k);
-                    leaf_array->insert(leaf, true);
+                    addLeaf(leaf_array, k);
                     leaf_array->writeUnlock();
                     return OperationResults::Success;
                 }
@@ -1014,8 +1381,445 @@ restart:
     //    std::cout<<"ohfinish\n";
 }
 
+typename Tree::OperationResults Tree::upsert(const Key *k, std::string *old) {
+    return readModifyWrite(k, nullptr, old);
+}
+
+// one descent as insert, the leaf array is changed under the locks of its
+// parent (as update) and of itself (as insert)
+typename Tree::OperationResults
+Tree::readModifyWrite(const Key *k, const Modifier &modify,
+                      std::string *old) {
+    if (!Leaf::fits(k->key_len, modify ? 0 : k->val_len))
+        return OperationResults::UnSuccess;
+    EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
+    std::string value;
+    Key nk;
+    // the key with its new value, nullptr if modify declines
+    auto modified = [&](Leaf *cur) -> const Key * {
+        // the leaf is retired by this operation, the caller gets a copy
+        if (old != nullptr && cur != nullptr)
+            old->assign(cur->GetValue(), cur->val_len);
+        else if (old != nullptr)
+            old->clear();
+        if (!modify)
+            return k;
+        value.clear();
+        if (!modify(cur, value) || !Leaf::fits(k->key_len, value.size()))
+            return nullptr;
+        nk.Init((char *)k->fkey, k->key_len, (char *)value.data(),
+                value.size());
+        return &nk;
+    };
+
+restart:
+    bool needRestart = false;
+    N *node = nullptr;
+    N *nextNode = root;
+    N *parentNode = nullptr;
+    uint8_t parentKey, nodeKey = 0;
+    uint32_t level = 0;
+
+    while (true) {
+        parentNode = node;
+        parentKey = nodeKey;
+        node = nextNode;
+#ifdef INSTANT_RESTART
+        node->check_generation();
+#endif
+        auto v = node->getVersion();
+
+        uint32_t nextLevel = level;
+
+        uint8_t nonMatchingKey;
+        Prefix remainingPrefix;
+        switch (
+            checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey,
+                                   remainingPrefix)) { // increases nextLevel
+        case CheckPrefixPessimisticResult::SkippedLevel:
+            goto restart;
+#ifdef LEAF_ARRAY
+        case CheckPrefixPessimisticResult::Empty:
+            dropEmptySubtree(node, parentNode, parentKey);
+            goto restart;
+#endif
+        case CheckPrefixPessimisticResult::NoMatch: {
+            assert(nextLevel < k->getKeyLen()); // prevent duplicate key
+            node->lockVersionOrRestart(v, needRestart);
+            if (needRestart)
+                goto restart;
+            const Key *newKey = modified(nullptr);
+            if (newKey == nullptr) {
+                node->writeUnlock();
+                return OperationResults::UnSuccess;
+            }
+
+            Prefix prefi = node->getPrefi();
+            prefi.prefixCount = nextLevel - level;
+
+#ifdef ARTPMDK
+            N4 *newNode = new (allocate_size(sizeof(N4))) N4(nextLevel, prefi);
+#else
+            auto newNode = new (alloc_new_node_from_type(NTypes::N4))
+                N4(nextLevel, prefi); // not persist
+#endif
+#ifdef LEAF_ARRAY
+            auto newLeafArray =
+                new (alloc_new_node_from_type(NTypes::LeafArray)) LeafArray();
+            auto *newLeaf = addLeaf(newLeafArray, newKey);
+            newNode->insert(k->fkey[nextLevel], N::setLeafArray(newLeafArray),
+                            false);
+#else
+            auto *newLeaf = allocLeaf(newKey);
+            newNode->insert(k->fkey[nextLevel], N::setLeaf(newLeaf), false);
+#endif
+            newNode->insert(nonMatchingKey, node, false);
+            flush_data((void *)newNode, sizeof(N4));
+
+            parentNode->writeLockOrRestart(needRestart);
+            if (needRestart) {
+                EpochGuard::DeleteNode((void *)newNode);
+#ifdef LEAF_ARRAY
+                if (!newLeafArray->isInline(newLeaf))
+                    EpochGuard::DeleteNode((void *)newLeaf);
+                EpochGuard::DeleteNode(newLeafArray);
+#else
+                EpochGuard::DeleteNode((void *)newLeaf);
+#endif
+
+                node->writeUnlock();
+                goto restart;
+            }
+
+            N::change(parentNode, parentKey, newNode);
+            parentNode->writeUnlock();
+
+            node->setPrefix(
+                remainingPrefix.prefix,
+                node->getPrefi().prefixCount - ((nextLevel - level) + 1), true);
+            node->writeUnlock();
+            return OperationResults::Success;
+        }
+        case CheckPrefixPessimisticResult::Match:
+            break;
+        }
+        assert(nextLevel < k->getKeyLen()); // prevent duplicate key
+
+        level = nextLevel;
+        nodeKey = k->fkey[level];
+
+        nextNode = N::getChild(nodeKey, node);
+
+        if (nextNode == nullptr) {
+            node->lockVersionOrRestart(v, needRestart);
+            if (needRestart)
+                goto restart;
+            const Key *newKey = modified(nullptr);
+            if (newKey == nullptr) {
+                node->writeUnlock();
+                return OperationResults::UnSuccess;
+            }
+#ifdef LEAF_ARRAY
+            auto newLeafArray =
+                new (alloc_new_node_from_type(NTypes::LeafArray)) LeafArray();
+            addLeaf(newLeafArray, newKey);
+            N::insertAndUnlock(node, parentNode, parentKey, nodeKey,
+                               N::setLeafArray(newLeafArray), needRestart);
+#else
+            Leaf *newLeaf = allocLeaf(newKey);
+            N::insertAndUnlock(node, parentNode, parentKey, nodeKey,
+                               N::setLeaf(newLeaf), needRestart);
+#endif
+            if (needRestart)
+                goto restart;
+
+            return OperationResults::Success;
+        }
+#ifdef LEAF_ARRAY
+        if (N::isLeafArray(nextNode)) {
+            node->lockVersionOrRestart(v, needRestart);
+            if (needRestart)
+                goto restart;
+            auto leaf_array = N::getLeafArray(nextNode);
+            auto lav = leaf_array->getVersion();
+            leaf_array->lockVersionOrRestart(lav, needRestart);
+            if (needRestart) {
+                node->writeUnlock();
+                goto restart;
+            }
+
+            Leaf *cur = leaf_array->lookup(k);
+            if (cur == nullptr && leaf_array->isFull()) {
+                // the split takes the lock of the parent itself
+                node->writeUnlock();
+                leaf_array->splitAndUnlock(node, nodeKey, needRestart);
+                if (needRestart)
+                    goto restart;
+                nextNode = N::getChild(nodeKey, node);
+                // insert at the next iteration
+                level++;
+                continue;
+            }
+
+            const Key *newKey = modified(cur);
+            if (newKey == nullptr) {
+                leaf_array->writeUnlock();
+                node->writeUnlock();
+                return OperationResults::UnSuccess;
+            }
+            if (cur != nullptr)
+                leaf_array->update(k, allocLeaf(newKey));
+            else
+                addLeaf(leaf_array, newKey);
+            leaf_array->writeUnlock();
+            node->writeUnlock();
+            return cur != nullptr ? OperationResults::Existed
+                                  : OperationResults::Success;
+        }
+#else
+        if (N::isLeaf(nextNode)) {
+            node->lockVersionOrRestart(v, needRestart);
+            if (needRestart)
+                goto restart;
+            Leaf *leaf = N::getLeaf(nextNode);
+            if (leaf->checkKey(k)) {
+                const Key *newKey = modified(leaf);
+                if (newKey == nullptr) {
+                    node->writeUnlock();
+                    return OperationResults::UnSuccess;
+                }
+                Leaf *newleaf = allocLeaf(newKey);
+                N::change(node, nodeKey, N::setLeaf(newleaf));
+                node->writeUnlock();
+                EpochGuard::DeleteNode((void *)leaf);
+                return OperationResults::Existed;
+            }
+            const Key *newKey = modified(nullptr);
+            if (newKey == nullptr) {
+                node->writeUnlock();
+                return OperationResults::UnSuccess;
+            }
+
+            level++;
+            uint32_t prefixLength = 0;
+#ifdef KEY_INLINE
+            while (level + prefixLength <
+                       std::min(k->getKeyLen(), leaf->getKeyLen()) &&
+                   leaf->kv[level + prefixLength] ==
+                       k->fkey[level + prefixLength]) {
+                prefixLength++;
+            }
+#else
+            while (level + prefixLength <
+                       std::min(k->getKeyLen(), leaf->getKeyLen()) &&
+                   leaf->fkey[level + prefixLength] ==
+                       k->fkey[level + prefixLength]) {
+                prefixLength++;
+            }
+#endif
+
+#ifdef ARTPMDK
+            N4 *n4 = new (allocate_size(sizeof(N4)))
+                N4(level + prefixLength, &k->fkey[level],
+                   prefixLength); // not persist
+#else
+            auto n4 = new (alloc_new_node_from_type(NTypes::N4))
+                N4(level + prefixLength, &k->fkey[level],
+                   prefixLength); // not persist
+#endif
+            Leaf *newLeaf = allocLeaf(newKey);
+            n4->insert(k->fkey[level + prefixLength], N::setLeaf(newLeaf),
+                       false);
+#ifdef KEY_INLINE
+            n4->insert(leaf->kv[level + prefixLength], nextNode, false);
+#else
+            n4->insert(leaf->fkey[level + prefixLength], nextNode, false);
+#endif
+            flush_data((void *)n4, sizeof(N4));
+
+            N::change(node, k->fkey[level - 1], n4);
+            node->writeUnlock();
+            return OperationResults::Success;
+        }
+#endif
+        level++;
+    }
+}
+
+#ifdef LEAF_ARRAY
+// The reverse of LeafArray::splitAndUnlock: a node whose children are leaf
+// arrays with at most LeafArrayMergeSize leaves in total is replaced by one
+// leaf array in its parent. Otherwise an emptied leaf array is removed from
+// its node, which shrinks through removeAndShrink. Both are best effort, a
+// lock which is not free leaves the tree as it is; the parent is spun on
+// before the trylocks below it, as the leaf array split does.
+void Tree::shrinkLeafArrays(N *node, uint8_t nodeKey, LeafArray *la,
+                            N *parentNode, uint8_t parentKey) {
+    bool needRestart = false;
+    if (parentNode != nullptr) {
+        // a cheap check first, stops at the first child which is not a leaf
+        // array or when the leaves do not fit
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        size_t leaves = 0;
+        uint32_t i = 0;
+        for (; i < childrenCount && leaves <= LeafArrayMergeSize; ++i) {
+            N *child = std::get<1>(children[i]);
+            if (!N::isLeafArray(child))
+                break;
+            leaves += N::getLeafArray(child)->getCount();
+        }
+        if (i == childrenCount && leaves <= LeafArrayMergeSize &&
+            mergeLeafArrays(node, parentNode, parentKey))
+            return;
+    }
+    if (la->getCount() != 0)
+        return;
+
+    node->writeLockOrRestart(needRestart);
+    if (needRestart)
+        return;
+    // the last child of an inner node stays, the node would be empty
+    if (N::getChild(nodeKey, node) != N::setLeafArray(la) ||
+        (parentNode != nullptr && N::getCount(node) <= 1)) {
+        node->writeUnlock();
+        return;
+    }
+    auto lav = la->getVersion();
+    la->lockVersionOrRestart(lav, needRestart);
+    if (needRestart || la->getCount() != 0) {
+        if (!needRestart)
+            la->writeUnlock();
+        node->writeUnlock();
+        return;
+    }
+    N::removeAndUnlock(node, nodeKey, parentNode, parentKey, needRestart);
+    if (needRestart) {
+        la->writeUnlock();
+        return;
+    }
+    la->writeUnlockObsolete();
+    EpochGuard::DeleteNode((void *)la);
+}
+
+// A node on a bound path of removeRange may hold many emptied leaf arrays,
+// the dropped subtrees among them. They are shrunk one at a time; a shrink
+// to a smaller node type retires node, so its replacement is read again
+// from the parent.
+void Tree::shrinkNode(N *node, N *parentNode, uint8_t parentKey) {
+    while (true) {
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        uint32_t i = 0;
+        while (i < childrenCount &&
+               !(N::isLeafArray(std::get<1>(children[i])) &&
+                 N::getLeafArray(std::get<1>(children[i]))->getCount() == 0))
+            i++;
+        if (i == childrenCount)
+            return;
+        uint8_t k = std::get<0>(children[i]);
+        N *child = std::get<1>(children[i]);
+
+        shrinkLeafArrays(node, k, N::getLeafArray(child), parentNode,
+                         parentKey);
+        if (N::isObsolete(node->getVersion())) {
+            if (parentNode == nullptr)
+                return;
+            node = N::getChild(parentKey, parentNode);
+            if (node == nullptr || N::isLeafArray(node))
+                return; // merged into one leaf array
+        } else if (N::getChild(k, node) == child) {
+            return; // a lock is taken or child is the last one
+        }
+    }
+}
+
+bool Tree::mergeLeafArrays(N *node, N *parentNode, uint8_t parentKey) {
+    bool needRestart = false;
+    parentNode->writeLockOrRestart(needRestart);
+    if (needRestart)
+        return false;
+    if (N::getChild(parentKey, parentNode) != node) {
+        parentNode->writeUnlock();
+        return false;
+    }
+
+    // locked[0] is node, the rest are its children
+    std::vector<N *> locked;
+    size_t leaves = 0;
+    bool merge = N::lockSubtree(node, locked);
+    for (size_t i = 1; merge && i < locked.size(); i++) {
+        if (locked[i]->getType() != NTypes::LeafArray) {
+            merge = false;
+            break;
+        }
+        leaves += static_cast<LeafArray *>(locked[i])->getCount();
+    }
+    if (!merge || leaves > LeafArrayMergeSize) {
+        for (N *n : locked)
+            n->writeUnlock();
+        parentNode->writeUnlock();
+        return false;
+    }
+
+    auto merged = new (alloc_new_node_from_type(NTypes::LeafArray))
+        LeafArray(parentNode->getLevel());
+    for (size_t i = 1; i < locked.size(); i++) {
+        auto old = static_cast<LeafArray *>(locked[i]);
+        for (Leaf *leaf : old->getSortedLeaf(nullptr, nullptr, 0, false, false))
+            merged->insertFrom(old, leaf, false);
+    }
+    flush_data((void *)merged, sizeof(LeafArray));
+    N::change(parentNode, parentKey, N::setLeafArray(merged));
+    parentNode->writeUnlock();
+
+    for (N *n : locked) {
+        n->writeUnlockObsolete();
+        EpochGuard::DeleteNode((void *)n);
+    }
+    return true;
+}
+
+// A merge which gave up can leave a node whose leaf arrays are all empty.
+// Its prefix past maxStoredPrefixLength is only known from a leaf below it,
+// so an insert can not split or pass it; it is replaced as removeRange
+// replaces a dropped subtree, and the insert takes the empty leaf array.
+void Tree::dropEmptySubtree(N *node, N *parentNode, uint8_t parentKey) {
+    bool needRestart = false;
+    if (parentNode == nullptr)
+        return;
+    parentNode->writeLockOrRestart(needRestart);
+    if (needRestart)
+        return;
+    std::vector<N *> locked;
+    if (N::getChild(parentKey, parentNode) == node &&
+        N::lockSubtree(node, locked) && N::getAnyChildTid(node) == nullptr) {
+        auto empty = new (alloc_new_node_from_type(NTypes::LeafArray))
+            LeafArray();
+        flush_data((void *)empty, sizeof(LeafArray));
+        N::change(parentNode, parentKey, N::setLeafArray(empty));
+        parentNode->writeUnlock();
+        for (N *n : locked)
+            n->writeUnlockObsolete();
+        N::retireSubtree(node);
+        return;
+    }
+    for (N *n : locked)
+        n->writeUnlock();
+    parentNode->writeUnlock();
+}
+#endif
+
 typename Tree::OperationResults Tree::remove(const Key *k) {
     EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    touch(k);
+#endif
 restart:
     bool needRestart = false;
 
@@ -1073,6 +1877,15 @@ restart:
                 if (!result) {
                     return OperationResults::NotFound;
                 } else {
+                    // the children of node fit into one leaf array only if
+                    // one of them has at most bound leaves, the scan of
+                    // shrinkLeafArrays runs when this leaf array gets down to
+                    // bound and when it is empty, not on every remove
+                    size_t count = leaf_array->getCount();
+                    size_t bound = LeafArrayMergeSize / N::getCount(node);
+                    if (count == 0 || count == bound)
+                        shrinkLeafArrays(node, nodeKey, leaf_array, parentNode,
+                                         parentKey);
                     return OperationResults::Success;
                 }
             }
@@ -1154,6 +1967,146 @@ restart:
     }
 }
 
+#ifdef LEAF_ARRAY
+// A subtree between the two bound paths is replaced by an empty leaf array
+// with one N::change on its parent and retired as a whole, only the leaf
+// arrays on a bound path compare keys. Afterwards every node on a bound
+// path drops its empty leaf arrays or merges, so the shape follows the
+// keys that are left. The parent is locked with the
+// version its children were read under, the subtree only by trylock since
+// a leaf array split holds its lock while it waits for the parent. Any
+// conflict restarts from the root, the keys removed so far stay removed.
+std::size_t Tree::removeRange(const Key *start, const Key *end) {
+    if (start != nullptr && end != nullptr && !N::key_key_lt(start, end))
+        return 0;
+    EpochGuard NewEpoch;
+#ifdef INSTANT_RESTART
+    if (start != nullptr)
+        touch(start);
+#endif
+    std::size_t removed = 0;
+    bool restart = false;
+
+    // replace the child k of node by an empty leaf array, node is locked
+    // with v, the children were read under it
+    auto unlink = [&](N *node, uint64_t &v, uint8_t k, N *child,
+                      bool onlyEmpty) {
+        bool needRestart = false;
+        node->lockVersionOrRestart(v, needRestart);
+        if (needRestart) {
+            restart = true;
+            return;
+        }
+        std::vector<N *> locked;
+        if (!N::lockSubtree(child, locked)) {
+            restart = true;
+        } else if (!onlyEmpty || N::getAnyChildTid(child) == nullptr) {
+            auto empty = new (alloc_new_node_from_type(NTypes::LeafArray))
+                LeafArray();
+            flush_data((void *)empty, sizeof(LeafArray));
+            N::change(node, k, N::setLeafArray(empty));
+            node->writeUnlock();
+            v += 0b10;
+            for (N *n : locked)
+                n->writeUnlockObsolete();
+            removed += N::retireSubtree(child);
+            return;
+        }
+        for (N *n : locked)
+            n->writeUnlock();
+        node->writeUnlock();
+        v += 0b10;
+    };
+
+    std::function<void(N *, N *, uint8_t, uint32_t, bool, bool)> drop =
+        [&](N *node, N *parentNode, uint8_t parentKey, uint32_t level,
+            bool compare_start, bool compare_end) {
+#ifdef INSTANT_RESTART
+            node->check_generation();
+#endif
+            uint64_t v = node->getVersion();
+            if (N::isObsolete(v)) {
+                restart = true;
+                return;
+            }
+            uint8_t startLevel, endLevel;
+            if (!narrowRange(node, start, end, level, compare_start,
+                             compare_end, startLevel, endLevel, restart))
+                return;
+
+            std::tuple<uint8_t, N *> children[256];
+            uint32_t childrenCount = 0;
+            N::getChildren(node, startLevel, endLevel, children,
+                           childrenCount);
+            for (uint32_t i = 0; i < childrenCount && !restart; ++i) {
+                const uint8_t k = std::get<0>(children[i]);
+                N *child = std::get<1>(children[i]);
+                bool onStart = compare_start && k == startLevel;
+                bool onEnd = compare_end && k == endLevel;
+                bool needRestart = false;
+
+                if (N::isLeafArray(child)) {
+                    auto la = N::getLeafArray(child);
+                    auto lav = la->getVersion();
+                    la->lockVersionOrRestart(lav, needRestart);
+                    if (needRestart) {
+                        restart = true;
+                        return;
+                    }
+                    removed +=
+                        la->removeRange(start, end, level + 1, onStart, onEnd);
+                    la->writeUnlock();
+                    continue;
+                }
+                if (onStart || onEnd) {
+                    // dropped as well if nothing is left on the path, unless
+                    // it is merged into a leaf array already
+                    drop(child, node, k, level + 1, onStart, onEnd);
+                    if (!restart && !N::isObsolete(child->getVersion()) &&
+                        N::getAnyChildTid(child) == nullptr)
+                        unlink(node, v, k, child, true);
+                    continue;
+                }
+                unlink(node, v, k, child, false);
+            }
+            // bottom up, so a child merged into a leaf array above is
+            // shrunk with node
+            if (!restart)
+                shrinkNode(node, parentNode, parentKey);
+        };
+
+    do {
+        restart = false;
+        drop(root, nullptr, 0, 0, start != nullptr, end != nullptr);
+    } while (restart);
+    return removed;
+}
+#else
+// a subtree can not be replaced by an empty one without leaf arrays, the
+// keys are removed one by one
+std::size_t Tree::removeRange(const Key *start, const Key *end) {
+    const std::size_t batch = 64;
+    Leaf *result[batch];
+    std::size_t removed = 0;
+
+    while (true) {
+        std::size_t count = 0;
+        scanReverse(start, end, false, result, batch, count);
+        if (count == 0)
+            return removed;
+        std::vector<std::string> keys;
+        for (std::size_t i = 0; i < count; i++)
+            keys.push_back(std::string(result[i]->GetKey(), result[i]->key_len));
+        for (auto &key : keys) {
+            Key k;
+            k.Init((char *)key.data(), key.size(), nullptr, 0);
+            if (remove(&k) == OperationResults::Success)
+                removed++;
+        }
+    }
+}
+#endif
+
 void Tree::rebuild(std::vector<std::pair<uint64_t, size_t>> &rs,
                    uint64_t start_addr, uint64_t end_addr, int thread_id) {
     // rebuild meta data count/compactcount
@@ -1161,6 +2114,82 @@ void Tree::rebuild(std::vector<std::pair<uint64_t, size_t>> &rs,
     N::rebuild_node(root, rs, start_addr, end_addr, thread_id);
 }
 
+#ifdef INSTANT_RESTART
+void Tree::startRecovery(int thread_num) {
+    assert(recovery_workers.empty());
+    for (int i = 0; i < 256; i++) {
+        heat[i].store(0);
+        claimed[i].store(false);
+    }
+    recovering.store(true);
+    for (int i = 0; i < thread_num; i++) {
+        recovery_workers.push_back(new std::thread(&Tree::recoveryWork, this));
+    }
+}
+
+bool Tree::waitRecovery() {
+    if (recovery_workers.empty())
+        return false;
+    for (auto t : recovery_workers) {
+        t->join();
+        delete t;
+    }
+    recovery_workers.clear();
+    recovering.store(false);
+    return true;
+}
+
+void Tree::recoveryWork() {
+    register_threadinfo();
+    while (true) {
+        // claim the hottest subtree which is not repaired yet
+        int hottest = -1;
+        uint32_t max_heat = 0;
+        for (int i = 0; i < 256; i++) {
+            if (claimed[i].load() == false &&
+                (hottest == -1 || heat[i].load() > max_heat)) {
+                hottest = i;
+                max_heat = heat[i].load();
+            }
+        }
+        if (hottest == -1)
+            break;
+        bool expected = false;
+        if (!claimed[hottest].compare_exchange_strong(expected, true))
+            continue;
+
+        EpochGuard NewEpoch;
+        N *child = N::getChild((uint8_t)hottest, root);
+        if (child != nullptr)
+            recoverSubtree(child);
+#ifdef QSBR
+        QuiescentState();
+#endif
+    }
+    unregister_threadinfo();
+}
+
+// repair the node and all its descendants
+void Tree::recoverSubtree(N *node) {
+#ifdef LEAF_ARRAY
+    if (N::isLeafArray(node)) {
+        N::getLeafArray(node)->check_generation();
+        return;
+    }
+#endif
+    if (N::isLeaf(node))
+        return;
+
+    std::tuple<uint8_t, N *> children[256];
+    uint32_t childrenCount = 0;
+    // getChildren repairs the node first
+    N::getChildren(node, 0, 255, children, childrenCount);
+    for (uint32_t i = 0; i < childrenCount; i++) {
+        recoverSubtree(std::get<1>(children[i]));
+    }
+}
+#endif
+
 typename Tree::CheckPrefixResult Tree::checkPrefix(N *n, const Key *k,
                                                    uint32_t &level) {
     if (k->getKeyLen() <= n->getLevel()) {
@@ -1210,6 +2239,10 @@ Tree::checkPrefixPessimistic(N *n, const Key *k, uint32_t &level,
                 (n->getLevel() > level ? n->getLevel() - level
                                        : level - n->getLevel());
             Leaf *kr = N::getAnyChildTid(n);
+            if (kr == nullptr) {
+                n->writeUnlock();
+                return CheckPrefixPessimisticResult::Empty;
+            }
             p.prefixCount = discrimination;
             for (uint32_t i = 0;
                  i < std::min(discrimination, maxStoredPrefixLength); i++) {
@@ -1241,6 +2274,8 @@ Tree::checkPrefixPessimistic(N *n, const Key *k, uint32_t &level,
                 //            if (i == maxStoredPrefixLength) {
                 // Optimistic path compression
                 kt = N::getAnyChildTid(n);
+                if (kt == nullptr)
+                    return CheckPrefixPessimisticResult::Empty;
                 load_flag = true;
             }
 #ifdef KEY_INLINE
@@ -1255,6 +2290,8 @@ Tree::checkPrefixPessimistic(N *n, const Key *k, uint32_t &level,
                 if (p.prefixCount > maxStoredPrefixLength) {
                     if (i < maxStoredPrefixLength) {
                         kt = N::getAnyChildTid(n);
+                        if (kt == nullptr)
+                            return CheckPrefixPessimisticResult::Empty;
                     }
                     for (uint32_t j = 0;
                          j < std::min((p.prefixCount - (level - prevLevel) - 1),
@@ -1294,6 +2331,9 @@ Tree::checkPrefixCompare(const N *n, const Key *k, uint32_t &level) {
             if (i >= maxStoredPrefixLength && !load_flag) {
                 // loadKey(N::getAnyChildTid(n), kt);
                 kt = N::getAnyChildTid(n);
+                // no key below n: the range scans skip n or copy nothing
+                if (kt == nullptr)
+                    return PCCompareResults::Smaller;
                 load_flag = true;
             }
             uint8_t kLevel =
@@ -1333,6 +2373,8 @@ typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n,
             if (i >= maxStoredPrefixLength && !load_flag) {
                 // loadKey(N::getAnyChildTid(n), kt);
                 kt = N::getAnyChildTid(n);
+                if (kt == nullptr)
+                    return PCEqualsResults::NoMatch;
                 load_flag = true;
             }
             uint8_t startLevel =
@@ -1357,6 +2399,23 @@ typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n,
     }
     return PCEqualsResults::BothMatch;
 }
+void Tree::countNodes(std::size_t &inner, std::size_t &leafArrays) const {
+    inner = leafArrays = 0;
+    std::function<void(N *)> walk = [&](N *node) {
+        if (N::isLeaf(node)) {
+            leafArrays++;
+            return;
+        }
+        inner++;
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount; ++i)
+            walk(std::get<1>(children[i]));
+    };
+    walk(root);
+}
+
 void Tree::graphviz_debug() {
     std::ofstream f("../dot/tree-view.dot");
 
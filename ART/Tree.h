@@ -5,8 +5,13 @@
 #include "N4.h"
 #include "N48.h"
 #include "LeafArray.h"
+#include <atomic>
+#include <functional>
 #include <libpmemobj.h>
 #include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace PART_ns {
 
@@ -17,13 +22,65 @@ class Tree {
 
     bool checkKey(const Key *ret, const Key *k) const;
 
+#ifdef LEAF_ARRAY
+    // after a remove from la, the child nodeKey of node: merge the leaf
+    // arrays of node if they are small or drop la if it is empty
+    void shrinkLeafArrays(N *node, uint8_t nodeKey, LeafArray *la,
+                          N *parentNode, uint8_t parentKey);
+
+    // replace node by one leaf array holding all of its leaves, false if
+    // they do not fit or a lock is taken
+    bool mergeLeafArrays(N *node, N *parentNode, uint8_t parentKey);
+
+    // shrinkLeafArrays for every empty leaf array of node, until node is
+    // merged away or a lock is taken
+    void shrinkNode(N *node, N *parentNode, uint8_t parentKey);
+
+    // replace node, which has no leaf below it, by an empty leaf array in
+    // its parent; best effort, the caller restarts
+    void dropEmptySubtree(N *node, N *parentNode, uint8_t parentKey);
+#endif
+
+    // the child bytes of node which may hold keys of [start, end], false if
+    // there are none or on a concurrent change (restart)
+    static bool narrowRange(const N *node, const Key *start, const Key *end,
+                            uint32_t &level, bool &compare_start,
+                            bool &compare_end, uint8_t &startLevel,
+                            uint8_t &endLevel, bool &restart);
+
+    // leaves of [start, end), or [start, end] if endInclusive, from the
+    // largest down; lastKey is set to a copy of the key of the last leaf,
+    // taken while the leaves are protected
+    bool scanReverse(const Key *start, const Key *end, bool endInclusive,
+                     Leaf *result[], std::size_t resultLen,
+                     std::size_t &resultCount,
+                     std::string *lastKey = nullptr) const;
+
+#ifdef INSTANT_RESTART
+    // background recovery after an instant restart, the subtrees under root
+    // are repaired in the order of how often they are touched meanwhile
+    std::atomic<bool> recovering;
+    mutable std::atomic<uint32_t> heat[256];
+    std::atomic<bool> claimed[256];
+    std::vector<std::thread *> recovery_workers;
+
+    inline void touch(const Key *k) const {
+        if (recovering.load(std::memory_order_relaxed))
+            heat[k->fkey[0]].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recoveryWork();
+    static void recoverSubtree(N *node);
+#endif
+
   public:
     enum class CheckPrefixResult : uint8_t { Match, NoMatch, OptimisticMatch };
 
     enum class CheckPrefixPessimisticResult : uint8_t {
         Match,
         NoMatch,
-        SkippedLevel
+        SkippedLevel,
+        Empty // no leaf below the node, its long prefix is unknown
     };
 
     enum class PCCompareResults : uint8_t {
@@ -42,7 +99,7 @@ class Tree {
         Success,
         NotFound, // remove
         Existed,  // insert
-        UnSuccess
+        UnSuccess // or a key/value too long for a leaf
     };
     static CheckPrefixResult checkPrefix(N *n, const Key *k, uint32_t &level);
 
@@ -66,6 +123,14 @@ class Tree {
     void rebuild(std::vector<std::pair<uint64_t, size_t>> &rs,
                  uint64_t start_addr, uint64_t end_addr, int thread_id);
 
+#ifdef INSTANT_RESTART
+    // repair all nodes of the last run with thread_num background threads
+    void startRecovery(int thread_num);
+
+    // wait for the background recovery, false if it is not started
+    bool waitRecovery();
+#endif
+
     Leaf *lookup(const Key *k) const;
 
     OperationResults update(const Key *k) const;
@@ -74,12 +139,81 @@ class Tree {
                      Leaf *result[], std::size_t resultLen,
                      std::size_t &resultCount) const;
 
+    // every leaf whose key starts with the key_len bytes of prefix, in key
+    // order, until visit returns false; the number of visited leaves
+    typedef std::function<bool(Leaf *leaf)> Visitor;
+    std::size_t scanPrefix(const Key *prefix, const Visitor &visit) const;
+
+    // as lookupRange in descending order: the largest resultLen leaves of
+    // [start, end), start or end may be nullptr for an open bound; true if
+    // the range holds more keys
+    bool lookupRangeReverse(const Key *start, const Key *end, Leaf *result[],
+                            std::size_t resultLen,
+                            std::size_t &resultCount) const;
+
+    // walks the keys from the largest downwards, one descent fetches batch
+    // leaves, which stay valid as lookup results do
+    class ReverseIterator {
+      public:
+        ReverseIterator(const Tree *tree_, std::size_t batch = 32);
+
+        // position at the largest key <= k
+        void seekForPrev(const Key *k);
+        // position at the largest key
+        void seekToLast();
+        // move to the next smaller key
+        void prev();
+
+        bool valid() const { return pos < count; }
+        Leaf *leaf() const { return buf[pos]; }
+
+      private:
+        void fill(const Key *bound, bool inclusive);
+
+        const Tree *tree;
+        std::vector<Leaf *> buf;
+        std::size_t pos, count;
+        bool more;
+        // the smallest key of the batch, the next batch is below it
+        std::string last;
+    };
+
     OperationResults insert(const Key *k);
 
+    // the new value of a key from its current leaf (nullptr if the key does
+    // not exist), false to leave the key unchanged
+    typedef std::function<bool(const Leaf *old, std::string &value)> Modifier;
+
+    // insert k or replace the value of an existing key in one descent,
+    // Success if inserted, Existed if replaced; old is set to a copy of the
+    // replaced value, the replaced leaf is retired
+    OperationResults upsert(const Key *k, std::string *old = nullptr);
+
+    // write the value computed by modify under the lock of the key, as
+    // upsert; UnSuccess if modify declines. modify is called again if the
+    // operation restarts, the value of the last call is written. The leaf
+    // passed to modify is only valid during the call
+    OperationResults readModifyWrite(const Key *k, const Modifier &modify,
+                                     std::string *old = nullptr);
+
     OperationResults remove(const Key *k);
 
+    // remove every key of [start, end), start or end may be nullptr for an
+    // open bound; subtrees inside the range are dropped as a whole. the
+    // number of removed keys
+    std::size_t removeRange(const Key *start, const Key *end);
+
     Leaf *allocLeaf(const Key *k) const;
 
+#ifdef LEAF_ARRAY
+    // the leaf of k in la, kept in la with INLINE_LEAF if it is small
+    Leaf *addLeaf(LeafArray *la, const Key *k) const;
+#endif
+
+    // the number of inner nodes and of leaf arrays (leaves without
+    // LEAF_ARRAY) in the tree, not safe against concurrent writers
+    void countNodes(std::size_t &inner, std::size_t &leafArrays) const;
+
     void graphviz_debug();
 } __attribute__((aligned(64)));
 
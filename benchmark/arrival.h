@@ -0,0 +1,51 @@
+#pragma once
+
+#include "config.h"
+#include "histogram.h"
+#include "util.h"
+#include <random>
+#include <stdint.h>
+
+/*
+ * Arrival schedule of an open-loop worker
+ *
+ * Operations are issued at scheduled times instead of right after the last
+ * one finishes. The gaps are constant or exponential (Poisson arrivals) with
+ * the mean of the worker's rate. A worker which falls behind the schedule
+ * does not skip arrivals, so the latency measured from the scheduled start
+ * includes the queueing delay.
+ */
+class ArrivalSchedule {
+  public:
+    // rate is operations per second of this worker
+    ArrivalSchedule(ArrivalType type, double rate, int seed)
+        : type(type), gen(seed + 1), exp_gap(1.0) {
+        mean_gap = rate > 0 ? cycles_per_ns() * 1000000000.0 / rate : 0;
+    }
+
+    // the same clock as the latencies of the histograms
+    static double cycles_per_ns() { return LatencyHistogram::cycles_per_ns(); }
+
+    bool open_loop() const { return type != CLOSED_LOOP; }
+
+    void start() { next = (double)rdtsc(); }
+
+    // wait until the next arrival, return its scheduled time in cycles
+    inline uint64_t wait() {
+        uint64_t scheduled = (uint64_t)next;
+        while (rdtsc() < scheduled)
+            ;
+        if (type == POISSON)
+            next += mean_gap * exp_gap(gen);
+        else
+            next += mean_gap;
+        return scheduled;
+    }
+
+  private:
+    ArrivalType type;
+    double mean_gap; // cycles
+    double next;     // cycles, not rounded to keep the mean rate
+    std::mt19937_64 gen;
+    std::exponential_distribution<double> exp_gap;
+};
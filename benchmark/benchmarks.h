@@ -30,6 +30,8 @@ static Benchmark *getBenchmark(Config conf) {
         return new ScanBench(conf);
     case RECOVERY_BENCH:
         return new UpdateOnlyBench(conf);
+    case TRACE_BENCH:
+        return new TraceBench(conf);
     default:
         printf("none support benchmark %d\n", conf.benchmark);
         exit(0);
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "topology.h"
 #include <cassert>
 #include <getopt.h>
 #include <iostream>
+#include <sstream>
 #include <unistd.h>
+#include <vector>
 
 const int max_thread_num = 36;
 
@@ -15,6 +18,35 @@ enum KeyType { Integer, String, _KeyTypeNumber };
 
 enum DataDistrubute { RANDOM, ZIPFIAN, _DataDistrbuteNumber };
 
+// shape of the generated string keys
+enum KeyShape {
+    DIGIT_KEY,     // 5-15 random digits
+    EMAIL_KEY,     // /tmp/email_key if it exists, generated emails otherwise
+    URL_KEY,       // urls sharing a deep prefix
+    COMPOSITE_KEY, // tenant|table|id
+    TIMESTAMP_KEY, // increasing timestamps
+    LONG_KEY,      // paths of more than 64 bytes
+    _KeyShapeNumber
+};
+
+static inline const char *key_shape_name(int shape) {
+    static const char *names[_KeyShapeNumber] = {
+        "digit", "email", "url", "composite", "timestamp", "long"};
+    return (shape >= 0 && shape < _KeyShapeNumber) ? names[shape] : "unknown";
+}
+
+enum OperationType {
+    INSERT,
+    REMOVE,
+    UPDATE,
+    GET,
+    SCAN,
+    MIXED,
+    _OpreationTypeNumber
+};
+
+enum ArrivalType { CLOSED_LOOP, CONSTANT, POISSON, _ArrivalTypeNumber };
+
 enum BenchMarkType {
     READ_ONLY,
     INSERT_ONLY,
@@ -30,6 +62,7 @@ enum BenchMarkType {
 
     SCAN_BENCH,
     RECOVERY_BENCH,
+    TRACE_BENCH, // replay the binary trace of -f
     _BenchMarkType
 };
 
@@ -45,7 +78,7 @@ struct Config {
     bool share_memory;
     float duration;
 
-    int email;
+    KeyShape key_shape;
 
     std::string filename;
     DataDistrubute workload;
@@ -55,8 +88,31 @@ struct Config {
     int scan_length;
     int throughput;
     bool latency_test;
+    int op_stream; // log2 of pre-generated operations of every worker
+    bool sorted_load; // every loader inserts its keys in order
+    bool perf_counters; // hardware counters of every worker and loader
+    PinPolicy pin;      // cpu of every worker and loader
+
+    // sweep of every combination in one process, empty for the single value
+    std::vector<int> sweep_threads;
+    std::vector<int> sweep_types;
+    std::vector<int> sweep_benchmarks;
+    std::string output; // csv or json lines of the results
+
+    // a single run with an output file is a sweep of one
+    bool sweep() const {
+        return !sweep_threads.empty() || !sweep_types.empty() ||
+               !sweep_benchmarks.empty() || !output.empty();
+    }
+
+    bool histogram; // per-operation latency histograms
+    bool interval;  // print rolling percentiles every duration
+
+    ArrivalType arrival; // open-loop arrivals at the rate of -T
+    bool load_sweep;     // sweep the offered load until saturation
 
     bool instant_restart;
+    int recovery_threads; // background recovery threads after restart
 
     void report() {
         printf("--- Config ---\n");
@@ -76,10 +132,25 @@ static struct option opts[] = {
     {"duration", required_argument, NULL, 'd'},
     {"benchmark", required_argument, NULL, 'b'},
     {"filename", required_argument, NULL, 'f'},
+    {"key_shape", required_argument, NULL, 'e'},
     {"workload", required_argument, NULL, 'w'},
     {"skewness", required_argument, NULL, 'S'},
     {"scan_length", required_argument, NULL, 'l'},
     {"read_ratio", required_argument, NULL, 'r'},
+    {"histogram", no_argument, NULL, 'H'},
+    {"interval", no_argument, NULL, 'I'},
+    {"arrival", required_argument, NULL, 'A'},
+    {"load_sweep", no_argument, NULL, 'X'},
+    {"op_stream", required_argument, NULL, 'O'},
+    {"sorted_load", no_argument, NULL, 'B'},
+    {"perf_counters", no_argument, NULL, 'C'},
+    {"pin", required_argument, NULL, 'P'},
+    {"sweep_threads", required_argument, NULL, 'M'},
+    {"sweep_types", required_argument, NULL, 'Y'},
+    {"sweep_benchmarks", required_argument, NULL, 'Z'},
+    {"output", required_argument, NULL, 'o'},
+    {"instant_restart", no_argument, NULL, 'i'},
+    {"recovery_threads", required_argument, NULL, 'R'},
 };
 
 static void usage_exit(FILE *out) {
@@ -93,25 +164,63 @@ static void usage_exit(FILE *out) {
         "   -n --num_threads       : Number of workers \n"
         "   -k --keys              : Number of key-value pairs at begin\n"
         "   -L --value_length      : Length of string value\n"
-        "   -e --email             : Email List key: 0(rand) 1(email key)\n"
+        "   -e --key_shape         : String keys: 0 (random digits) 1 "
+        "(email) 2 (url) 3 (tenant|table|id) 4 (timestamp) 5 (long key)\n"
         "   -s --non_share_memory  : Use different index instances among "
         "different workers\n"
         "   -d --duration          : Execution time\n"
         "   -b --benchmark         : Benchmark type, 0-%d\n"
+        "   -f --filename          : Trace file of the trace benchmark\n"
+        "   -O --op_stream         : Every worker generates 2^n operations "
+        "before the timing, 0 to generate them on the fly (default 20). Only "
+        "streams without inserts and removes are replayed, the others go on "
+        "on the fly once they run out\n"
+        "   -B --sorted_load       : Every loader sorts its part of the "
+        "initial keys before inserting them\n"
+        "   -C --perf_counters     : Count cycles, instructions, LLC and dTLB "
+        "misses and stall cycles of the load and the timed run\n"
+        "   -P --pin               : Thread pinning: 0 (none) 1 (compact) 2 "
+        "(scatter) 3 (one socket first) 4 (no SMT) (default 3)\n"
+        "   -M --sweep_threads     : Sweep thread counts, e.g. 1,2,4,8\n"
+        "   -Y --sweep_types       : Sweep index types, e.g. 0,1,2\n"
+        "   -Z --sweep_benchmarks  : Sweep benchmarks, e.g. 0,7\n"
+        "   -o --output            : Write a row of every run to a csv file, "
+        "or json lines if it ends with .json or .jsonl\n"
         "   -w --workload          : type of workload: 0 (RANDOM) 1 (ZIPFIAN)\n"
         "   -S --skewed            : skewness: 0-1 (default 0.99)\n"
         "   -l --scan_length       : scan_length: int (default 100)\n"
-        "   -r --read_ratio        : read ratio: int (default 50)\n",
+        "   -r --read_ratio        : read ratio: int (default 50)\n"
+        "   -H --histogram         : Latency histograms of every operation "
+        "type\n"
+        "   -I --interval          : Print rolling latency percentiles every "
+        "second, implies -H\n"
+        "   -A --arrival           : Arrival of operations: 0 (closed loop) 1 "
+        "(constant rate) 2 (Poisson), open loop at the aggregate rate of -T\n"
+        "   -X --load_sweep        : Sweep the offered load of the open loop "
+        "from 10%% of the closed loop throughput until saturation\n"
+        "   -i --instant_restart   : Test instant restart\n"
+        "   -R --recovery_threads  : Background recovery threads after instant "
+        "restart, the recovery benchmark sweeps 1 to it (default 4)\n",
         _BenchMarkType - 1);
     exit(EXIT_FAILURE);
 }
 
+// comma separated integers
+static std::vector<int> parse_list(const char *arg) {
+    std::vector<int> list;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        list.push_back(atoi(item.c_str()));
+    return list;
+}
+
 static void parse_arguments(int argc, char *argv[], Config &state) {
     // Default Values
     state.type = PART;
     state.num_threads = 4;
     state.key_type = String;
-    state.email = 0;
+    state.key_shape = DIGIT_KEY;
     state.init_keys = 20000000;
     state.time = 5;
     state.val_length = 8;
@@ -124,13 +233,23 @@ static void parse_arguments(int argc, char *argv[], Config &state) {
     state.read_ratio = 50;
     state.throughput = 10000000;
     state.latency_test = false;
+    state.op_stream = 20;
+    state.sorted_load = false;
+    state.perf_counters = false;
+    state.pin = PIN_SOCKET_FIRST;
+    state.histogram = false;
+    state.interval = false;
+    state.arrival = CLOSED_LOOP;
+    state.load_sweep = false;
     state.instant_restart = false;
+    state.recovery_threads = 4;
 
     // Parse args
     while (1) {
         int idx = 0;
-        int c = getopt_long(argc, argv, "f:t:K:n:k:L:sd:b:w:S:l:r:T:e:i", opts,
-                            &idx);
+        int c = getopt_long(argc, argv,
+                            "f:t:K:n:k:L:sd:b:w:S:l:r:T:e:HIA:XO:BCP:M:Y:Z:o:iR:",
+                            opts, &idx);
 
         if (c == -1)
             break;
@@ -149,7 +268,7 @@ static void parse_arguments(int argc, char *argv[], Config &state) {
             state.key_type = (KeyType)atoi(optarg);
             break;
         case 'e':
-            state.email = atoi(optarg);
+            state.key_shape = (KeyShape)atoi(optarg);
             break;
         case 'n':
             state.num_threads = atoi(optarg);
@@ -185,14 +304,76 @@ static void parse_arguments(int argc, char *argv[], Config &state) {
         case 'h':
             usage_exit(stdout);
             break;
+        case 'H':
+            state.histogram = true;
+            break;
+        case 'I':
+            state.histogram = true;
+            state.interval = true;
+            break;
+        case 'A':
+            state.arrival = (ArrivalType)atoi(optarg);
+            break;
+        case 'X':
+            state.load_sweep = true;
+            break;
+        case 'O':
+            state.op_stream = atoi(optarg);
+            break;
+        case 'B':
+            state.sorted_load = true;
+            break;
+        case 'C':
+            state.perf_counters = true;
+            break;
+        case 'P':
+            state.pin = (PinPolicy)atoi(optarg);
+            break;
+        case 'M':
+            state.sweep_threads = parse_list(optarg);
+            break;
+        case 'Y':
+            state.sweep_types = parse_list(optarg);
+            break;
+        case 'Z':
+            state.sweep_benchmarks = parse_list(optarg);
+            break;
+        case 'o':
+            state.output = std::string(optarg);
+            break;
         case 'i':
             state.instant_restart = true;
             break;
+        case 'R':
+            state.recovery_threads = atoi(optarg);
+            break;
         default:
             fprintf(stderr, "\nUnknown option: -%c-\n", c);
             usage_exit(stderr);
         }
     }
+    if (state.pin < 0 || state.pin >= _PinPolicyNumber)
+        usage_exit(stderr);
+    if (state.key_shape < 0 || state.key_shape >= _KeyShapeNumber)
+        usage_exit(stderr);
+#ifdef FIXED_KEY_LEN
+    if (state.type == PART &&
+        (state.key_type != Integer || FIXED_KEY_LEN != sizeof(uint64_t))) {
+        fprintf(stderr, "ART is built for %d byte keys, use integer keys\n",
+                FIXED_KEY_LEN);
+        exit(EXIT_FAILURE);
+    }
+#endif
+    if (state.load_sweep && state.arrival == CLOSED_LOOP)
+        state.arrival = POISSON;
+    if (state.arrival != CLOSED_LOOP) {
+        // -T is the offered rate instead of the pacing of latency test,
+        // latency is measured by the histograms from the scheduled start
+        state.latency_test = false;
+        state.histogram = true;
+        std::cout << (state.arrival == POISSON ? "Poisson" : "constant")
+                  << " arrivals\n";
+    }
     if (state.instant_restart == true) {
         std::cout << "----------test instant restart----------\n";
     }
@@ -202,10 +383,7 @@ static void parse_arguments(int argc, char *argv[], Config &state) {
     if (state.workload == ZIPFIAN)
         std::cout << "zipfian skewness " << state.skewness << "\n";
     std::cout << "read ratio: " << state.read_ratio << "\n";
-    if (state.email == 1) {
-        std::cout << "email key\n";
-    } else {
-        std::cout << "rand key\n";
-    }
+    if (state.key_type == String)
+        std::cout << key_shape_name(state.key_shape) << " key\n";
     // state.report();
 }
@@ -2,10 +2,16 @@
 #define coordinator_h
 
 #include "Key.h"
+#include "KeyCodec.h"
 #include "N.h"
 #include "Tree.h"
+#include "arrival.h"
 #include "benchmarks.h"
 #include "config.h"
+#include "histogram.h"
+#include "perf_counter.h"
+#include "report.h"
+#include "topology.h"
 #include <time.h>
 
 #ifdef ACMA
@@ -20,20 +26,21 @@
 #include "threadinfo.h"
 #include "timer.h"
 #include "util.h"
+#include <algorithm>
+#include <atomic>
 #include <boost/thread/barrier.hpp>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
+#include <signal.h>
 #include <string>
+#include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
 using namespace NVMMgr_ns;
 
-const int thread_to_core[36] = {
-    0,  4,  8,  12, 16, 20, 24, 28, 32,
-    36, 40, 44, 48, 52, 56, 60, 64, 68, // numa node 0
-    1,  5,  9,  13, 17, 21, 25, 29, 33,
-    37, 41, 45, 49, 53, 57, 61, 65, 69 // numa node 1
-};
-
 template <typename K, typename V, int size> class Coordinator {
     class Result {
       public:
@@ -44,6 +51,12 @@ template <typename K, typename V, int size> class Coordinator {
         long long count;
         long long helpcount;
         long long writecount;
+#ifdef COUNT_PERSIST
+        // persistence events of every operation type
+        long long op_count[_OpreationTypeNumber];
+        PersistCounter persist[_OpreationTypeNumber];
+#endif
+        PerfValues perf; // hardware counters of the timed loop
 
         Result() {
             throughput = 0;
@@ -54,6 +67,10 @@ template <typename K, typename V, int size> class Coordinator {
             for (int i = 0; i < 3; i++) {
                 update_latency_breaks[i] = find_latency_breaks[i] = 0;
             }
+#ifdef COUNT_PERSIST
+            memset(op_count, 0, sizeof(op_count));
+            memset(persist, 0, sizeof(persist));
+#endif
         }
 
         void operator+=(Result &r) {
@@ -66,6 +83,13 @@ template <typename K, typename V, int size> class Coordinator {
                 this->update_latency_breaks[i] += r.update_latency_breaks[i];
                 this->find_latency_breaks[i] += r.find_latency_breaks[i];
             }
+#ifdef COUNT_PERSIST
+            for (int i = 0; i < _OpreationTypeNumber; i++) {
+                this->op_count[i] += r.op_count[i];
+                this->persist[i] += r.persist[i];
+            }
+#endif
+            this->perf += r.perf;
         }
 
         void operator/=(double r) {
@@ -81,27 +105,367 @@ template <typename K, typename V, int size> class Coordinator {
     Coordinator(Config _conf) : conf(_conf) {}
 
     int stick_this_thread_to_core(int core_id) {
-        int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-        if (core_id < 0 || core_id >= num_cores)
-            return EINVAL;
+        return pin_thread(core_id, conf.pin);
+    }
+
+    void print_cpu_map(int threads) {
+        printf("[PIN]\t%s, %d threads: %s\n", pin_policy_name(conf.pin),
+               threads, CpuTopology::get().describe(conf.pin, threads).c_str());
+    }
+
+#ifdef QSBR
+    static const int qsbr_interval = 64; // operations between announcements
+#endif
+
+    // workers announce a quiescent state between operations
+    inline void quiescent(unsigned long tx) {
+#ifdef QSBR
+        if (tx % qsbr_interval == 0)
+            NVMMgr_ns::QuiescentState();
+#endif
+    }
+
+    // the coordinator holds no node while it waits for the workers
+    inline void go_offline() {
+#ifdef QSBR
+        if (NVMMgr_ns::get_threadinfo() != nullptr)
+            NVMMgr_ns::ThreadOffline();
+#endif
+    }
+
+    static const char *operation_name(int op) {
+        const char *op_name[_OpreationTypeNumber] = {
+            "insert", "remove", "update", "get", "scan", "mixed"};
+        return op_name[op];
+    }
+
+    // histograms of every operation type of a worker, null if disabled
+    LatencyHistogram *worker_histograms(int workerid) {
+        if (histograms == nullptr)
+            return nullptr;
+        return &histograms[workerid * _OpreationTypeNumber];
+    }
+
+    void alloc_histograms() {
+        delete[] histograms;
+        histograms = nullptr;
+        if (conf.histogram) {
+            histograms =
+                new LatencyHistogram[conf.num_threads * _OpreationTypeNumber];
+        }
+    }
+
+    // merge the histograms of all workers by operation type
+    void merge_histograms(HistogramSnapshot *s) {
+        for (int op = 0; op < _OpreationTypeNumber; op++) {
+            s[op].clear();
+            for (int i = 0; i < conf.num_threads; i++)
+                s[op].add(histograms[i * _OpreationTypeNumber + op]);
+        }
+    }
+
+    void print_latency() {
+        if (histograms == nullptr)
+            return;
+        HistogramSnapshot *s = new HistogramSnapshot[_OpreationTypeNumber];
+        merge_histograms(s);
+        for (int op = 0; op < _OpreationTypeNumber; op++) {
+            if (s[op].total > 0)
+                s[op].print("[LATENCY]", operation_name(op));
+        }
+        delete[] s;
+    }
+
+    // the monitor only runs in the interval mode, every second
+    std::thread *start_monitor() {
+        if (!conf.interval)
+            return nullptr;
+        return new std::thread(&Coordinator::monitor_work, this,
+                               conf.num_threads, std::min(1.0f, conf.duration));
+    }
+
+    size_t stream_length() {
+        return conf.op_stream > 0 ? 1ull << conf.op_stream : 0;
+    }
+
+    int barrier_count() {
+        return conf.num_threads + 1 + (conf.interval ? 1 : 0);
+    }
+
+#ifdef COUNT_PERSIST
+    // average persistence events per operation of every operation type
+    void print_persist(Result &r) {
+        for (int i = 0; i < _OpreationTypeNumber; i++) {
+            long long n = r.op_count[i];
+            if (n == 0)
+                continue;
+            PersistCounter &c = r.persist[i];
+            printf("[PERSIST]\t%s: %lld ops, per op clwb %.2lf, clflush "
+                   "%.2lf, fence %.2lf, flushed %.1lf bytes, pm block %.4lf, "
+                   "gc free %.2lf, help flush %.2lf\n",
+                   operation_name(i), n, (double)c.clwb / n, (double)c.clflush / n,
+                   (double)c.fence / n, (double)c.flush_bytes / n,
+                   (double)c.pm_block / n, (double)c.gc_free / n,
+                   (double)c.help_flush / n);
+        }
+    }
+#endif
+
+    // the counters of a worker or loader thread, nullptr unless enabled
+    PerfGroup *perf_group() {
+        return conf.perf_counters ? new PerfGroup() : nullptr;
+    }
+
+    // derived metrics of the hardware counters of a phase
+    void print_perf(const char *phase, const PerfValues &p, double ops) {
+        if (!conf.perf_counters)
+            return;
+        if (!p.any()) {
+            printf("[PERF]\t%s: no hardware counters\n", phase);
+            return;
+        }
+        if (ops < 1)
+            ops = 1;
+        printf("[PERF]\t%s:", phase);
+        if (p.valid[PERF_CYCLES] && p.valid[PERF_INSTRUCTIONS] &&
+            p.value[PERF_CYCLES] > 0)
+            printf(" IPC %.2lf,",
+                   (double)p.value[PERF_INSTRUCTIONS] / p.value[PERF_CYCLES]);
+        printf(" per op");
+        for (int e = 0; e < _PerfEventNumber; e++) {
+            if (p.valid[e])
+                printf(" %s %.2lf", perf_event_name(e), p.value[e] / ops);
+        }
+        printf("\n");
+    }
+
+    // fastfair and skiplist threads allocate from DCMM with a thread info
+    static bool dcmm_threadinfo() {
+#ifdef ACMA
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static const char *reclamation_mode() {
+#ifdef QSBR
+        return "QSBR";
+#else
+        return "epoch";
+#endif
+    }
+
+    // the initial keys of a loader in the order of the index
+    template <typename F>
+    void load_range(Benchmark *benchmark, unsigned long long begin,
+                    unsigned long long end, F &insert_key) {
+        if (!conf.sorted_load) {
+            for (unsigned long long i = begin; i < end; i++) {
+                if (conf.key_type == Integer)
+                    insert_key(benchmark->initIntKey(i), KeyView());
+                else
+                    insert_key(0, benchmark->initStrKey(i));
+            }
+            return;
+        }
+        if (conf.key_type == Integer) {
+            std::vector<long long> keys;
+            for (unsigned long long i = begin; i < end; i++)
+                keys.push_back(benchmark->initIntKey(i));
+            // ART stores integer keys big endian, every index has the
+            // order of the integers
+            std::sort(keys.begin(), keys.end());
+            for (long long d : keys)
+                insert_key(d, KeyView());
+        } else {
+            std::vector<KeyView> keys;
+            for (unsigned long long i = begin; i < end; i++)
+                keys.push_back(benchmark->initStrKey(i));
+            std::sort(keys.begin(), keys.end(),
+                      [](const KeyView &a, const KeyView &b) {
+                          int c = memcmp(a.data, b.data, std::min(a.len, b.len));
+                          return c < 0 || (c == 0 && a.len < b.len);
+                      });
+            for (const KeyView &s : keys)
+                insert_key(0, s);
+        }
+    }
+
+    // insert the initial keys with num_threads loaders, every loader inserts
+    // a contiguous part of the key set, the load throughput is a result too
+    template <typename F>
+    void parallel_load(Benchmark *benchmark, bool threadinfo, F insert_key) {
+        const int loaders = conf.num_threads;
+        const unsigned long long n = conf.init_keys;
+        printf("init keys: %llu, %d loaders\n", n, loaders);
+        if (conf.key_type == Integer)
+            benchmark->prepareLoad();
+
+        std::vector<std::thread> threads;
+        std::mutex perf_mtx;
+        PerfValues load_perf;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < loaders; t++) {
+            threads.emplace_back([&, t]() {
+                if (threadinfo)
+                    NVMMgr_ns::register_threadinfo();
+                stick_this_thread_to_core(t);
+                PerfGroup *perf = perf_group();
+                if (perf != nullptr)
+                    perf->start();
+                load_range(benchmark, n * t / loaders, n * (t + 1) / loaders,
+                           insert_key);
+                if (perf != nullptr) {
+                    PerfValues p = perf->stop();
+                    delete perf;
+                    std::lock_guard<std::mutex> lock(perf_mtx);
+                    load_perf += p;
+                }
+                if (threadinfo)
+                    NVMMgr_ns::unregister_threadinfo();
+            });
+        }
+        for (auto &t : threads)
+            t.join();
+        double sec = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+        printf("init insert finished\n");
+        printf("[LOAD]\t%s, %s, %llu keys, %d threads, %s, %.3lf s, %.3lf "
+               "Mop/s\n",
+               index_name(), (conf.key_type == Integer) ? "Int" : "Str", n,
+               loaders, conf.sorted_load ? "sorted" : "unsorted", sec,
+               n / sec / 1000000.0);
+        print_perf("load", load_perf, n);
+    }
+
+    // insert the initial keys of the benchmark
+    void art_load(PART_ns::Tree *art, Benchmark *benchmark) {
+        // variable value
+        const int val_len = conf.val_length;
+        char value[val_len + 5];
+        memset(value, 'a', val_len);
+        value[val_len] = 0;
+
+        parallel_load(benchmark, true, [&](long long kk, KeyView s) {
+            PART_ns::Key k;
+            // big endian, so that the tree orders the keys as integers
+            uint64_t ik = PART_ns::KeyCodec::order_u64(kk);
+            if (conf.key_type == Integer) {
+                //                std::string s = std::to_string(kk);
+                //                k->Init((char *)s.c_str(), s.size(), value,
+                //                val_len);
+                k.Init((char *)&ik, sizeof(uint64_t), value, val_len);
+            } else {
+                k.Init((char *)s.data, s.len, value, val_len);
+            }
+            art->insert(&k);
+        });
+    }
+
+    PART_ns::Tree *art_create() { return new PART_ns::Tree(); }
+
+    // an index can be destroyed only if its pool can be created again
+    bool art_destroy(PART_ns::Tree *art) {
+        delete art;
+        system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+        return true;
+    }
+
+    fastfair::btree *ff_create() {
+#ifdef USE_PMDK
+
+#ifdef ACMA
+        fastfair::btree *bt = new fastfair::btree();
+        std::cout << "[FF]\tcreate fastfair with DCMM\n";
+#else
+        fastfair::init_pmem();
+        fastfair::btree *bt =
+            new (fastfair::allocate(sizeof(fastfair::btree))) fastfair::btree();
+        std::cout << "[FF]\tPM create tree\n";
+#endif
+
+#else
+        fastfair::btree *bt = new fastfair::btree();
+        std::cout << "[FF]\tmemory create tree\n";
+#endif
+        return bt;
+    }
+
+    void ff_load(fastfair::btree *bt, Benchmark *benchmark) {
+        const int val_len = conf.val_length;
+        char value[val_len + 5];
+        memset(value, 'a', val_len);
+        value[val_len] = 0;
+        parallel_load(benchmark, dcmm_threadinfo(),
+                      [&](long long kk, KeyView s) {
+                          if (conf.key_type == Integer) {
+                              bt->btree_insert(kk, value);
+                          } else if (conf.key_type == String) {
+                              bt->btree_insert((char *)s.data, value);
+                          }
+                      });
+    }
 
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(thread_to_core[core_id], &cpuset);
+    skiplist::skiplist_t *sl_create() {
+#ifdef ACMA
+#else
 
-        pthread_t current_thread = pthread_self();
-        return pthread_setaffinity_np(current_thread, sizeof(cpu_set_t),
-                                      &cpuset);
+        skiplist::init_pmem();
+#endif
+        skiplist::skiplist_t *sl = skiplist::new_skiplist();
+        printf("skiplist create\n");
+        return sl;
+    }
+
+    void sl_load(skiplist::skiplist_t *sl, Benchmark *benchmark) {
+        const int val_len = conf.val_length;
+        char value[val_len + 5];
+        memset(value, 'a', val_len);
+        value[val_len] = 0;
+
+        parallel_load(benchmark, dcmm_threadinfo(),
+                      [&](long long kk, KeyView s) {
+#ifdef VARIABLE_LENGTH
+                          skiplist::skiplist_insert(sl, (char *)s.data, value);
+#else
+                          skiplist::skiplist_insert(sl, kk, kk);
+#endif
+                      });
+    }
+
+    // fastfair and skiplist with DCMM live in the pool of the nvm manager,
+    // the pmdk pools can not be created again in this process
+    template <typename Index> bool dcmm_destroy(Index *index) {
+#ifdef ACMA
+        NVMMgr_ns::unregister_threadinfo();
+        close_nvm_mgr();
+        system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+        return true;
+#else
+        return false;
+#endif
     }
 
     void art_worker(PART_ns::Tree *art, int workerid, Result *result,
                     Benchmark *b) {
-        //            Benchmark *benchmark = getBenchmark(conf);
+        // the operations come from a benchmark of this worker, freed when
+        // it finishes
         Benchmark *benchmark = getBenchmark(conf);
+        LatencyHistogram *hist = worker_histograms(workerid);
+        ArrivalSchedule schedule(conf.arrival,
+                                 (double)conf.throughput / conf.num_threads,
+                                 workerid);
         printf("[WORKER]\thello, I am worker %d\n", workerid);
         NVMMgr_ns::register_threadinfo();
         stick_this_thread_to_core(workerid);
+        OpStream stream(benchmark, conf.key_type, stream_length());
+        PerfGroup *perf = perf_group();
         bar->wait();
+        schedule.start();
+        if (perf != nullptr)
+            perf->start();
 
         unsigned long tx = 0;
 
@@ -164,30 +528,38 @@ template <typename K, typename V, int size> class Coordinator {
         cpuCycleTimer writeop;
 #endif
 
+#ifdef COUNT_PERSIST
+        Result *persist_result = result; // result is shadowed in the loop
+#endif
+
         while (done == 0) {
 
             V result = 1;
 
-            OperationType op;
-            long long d;
-            std::string s;
+            const Operation &next_operation = stream.next();
+            OperationType op = next_operation.op;
+            long long d = next_operation.ikey;
+            uint64_t ik = PART_ns::KeyCodec::order_u64(d);
 
             if (conf.key_type == Integer) {
-                auto next_operation = benchmark->nextIntOperation();
-                op = next_operation.first;
-                d = next_operation.second;
                 //                std::string s = std::to_string(d);
                 //                k->Init((char *)s.c_str(), s.size(), value,
                 //                val_len);
-                k->Init((char *)&d, sizeof(uint64_t), value, val_len);
+                k->Init((char *)&ik, sizeof(uint64_t), value, val_len);
             } else if (conf.key_type == String) {
-                auto next_operation = benchmark->nextStrOperation();
-                op = next_operation.first;
-                s = next_operation.second;
-                k->Init((char *)s.c_str(), s.size(), value, val_len);
+                int value_len = next_operation.value_len;
+                if (value_len == 0 || value_len > val_len)
+                    value_len = val_len;
+                k->Init((char *)next_operation.skey.data,
+                        next_operation.skey.len, value, value_len);
             }
 
             PART_ns::Tree::OperationResults res;
+#ifdef COUNT_PERSIST
+            PersistCounter before = persist_counter;
+#endif
+            uint64_t op_start = schedule.open_loop() ? schedule.wait()
+                                : (hist != nullptr ? rdtsc() : 0);
             switch (op) {
             case UPDATE: {
                 //                std::cout<<"update key "<<s<<"\n";
@@ -252,14 +624,31 @@ template <typename K, typename V, int size> class Coordinator {
                 exit(-1);
             }
             }
+            if (hist != nullptr)
+                hist[op].record(rdtsc() - op_start);
 
+#ifdef COUNT_PERSIST
+            persist_result->persist[op].add_delta(persist_counter, before);
+            persist_result->op_count[op]++;
+#endif
             tx++;
+            quiescent(tx);
         }
         result->throughput = tx;
+        if (perf != nullptr) {
+            result->perf = perf->stop();
+            delete perf;
+        }
         if (conf.latency_test) {
             result->total = t.duration();
             result->count = t.Countnum();
         }
+        if (hist != nullptr) {
+            HistogramSnapshot get;
+            get.add(hist[GET]);
+            result->total = LatencyHistogram::to_ns(get.sum());
+            result->count = get.total;
+        }
         result->helpcount = PART_ns::gethelpcount();
         result->writecount = write;
 
@@ -295,13 +684,19 @@ template <typename K, typename V, int size> class Coordinator {
                1.0 * PART_ns::get_count() / tx);
 #endif
 
+        delete benchmark;
         printf("[WORKER]\tworker %d finished\n", workerid);
     }
 
     void ff_worker(fastfair::btree *bt, int workerid, Result *result,
                    Benchmark *b) {
-        //            Benchmark *benchmark = getBenchmark(conf);
+        // the operations come from a benchmark of this worker, freed when
+        // it finishes
         Benchmark *benchmark = getBenchmark(conf);
+        LatencyHistogram *hist = worker_histograms(workerid);
+        ArrivalSchedule schedule(conf.arrival,
+                                 (double)conf.throughput / conf.num_threads,
+                                 workerid);
         printf("[WORKER]\thello, I am worker %d\n", workerid);
         stick_this_thread_to_core(workerid);
 #ifdef ACMA
@@ -309,7 +704,12 @@ template <typename K, typename V, int size> class Coordinator {
 #else
         fastfair::register_thread();
 #endif
+        OpStream stream(benchmark, conf.key_type, stream_length());
+        PerfGroup *perf = perf_group();
         bar->wait();
+        schedule.start();
+        if (perf != nullptr)
+            perf->start();
 
         unsigned long tx = 0;
 
@@ -361,37 +761,35 @@ template <typename K, typename V, int size> class Coordinator {
         uint64_t buf[505];
         char scan_value[val_len + 5];
 
+#ifdef COUNT_PERSIST
+        Result *persist_result = result; // result is shadowed in the loop
+#endif
+
         while (done == 0) {
 
             V result = 1;
-            OperationType op;
-            long long d;
-            std::string s;
-
-            if (conf.key_type == Integer) {
-                auto next_operation = benchmark->nextIntOperation();
-
-                op = next_operation.first;
-                d = next_operation.second;
-            } else if (conf.key_type == String) {
-                auto next_operation = benchmark->nextStrOperation();
-
-                op = next_operation.first;
-                s = next_operation.second;
-            }
+            const Operation &next_operation = stream.next();
+            OperationType op = next_operation.op;
+            long long d = next_operation.ikey;
+            char *skey = (char *)next_operation.skey.data;
 
             cpuCycleTimer t;
             if (conf.latency_test) {
                 t.start();
             }
 
+#ifdef COUNT_PERSIST
+            PersistCounter before = persist_counter;
+#endif
+            uint64_t op_start = schedule.open_loop() ? schedule.wait()
+                                : (hist != nullptr ? rdtsc() : 0);
             switch (op) {
             case UPDATE: {
                 if (conf.key_type == Integer) {
                     //                    std::cout<<"insert key "<<d<<"\n";
                     bt->btree_update(d, value);
                 } else if (conf.key_type == String) {
-                    bt->btree_update((char *)s.c_str(), value);
+                    bt->btree_update(skey, value);
                 }
 
                 break;
@@ -403,7 +801,7 @@ template <typename K, typename V, int size> class Coordinator {
                     //                    std::cout<<"insert key "<<d<<"\n";
                     bt->btree_insert(d, value);
                 } else if (conf.key_type == String) {
-                    bt->btree_insert((char *)s.c_str(), value);
+                    bt->btree_insert(skey, value);
                 }
 
                 //                if (conf.key_type == Integer) {
@@ -436,7 +834,7 @@ template <typename K, typename V, int size> class Coordinator {
                     bt->btree_delete(d);
                 } else if (conf.key_type == String) {
                     //                    std::cout<<"delete key "<<s<<"\n";
-                    bt->btree_delete((char *)s.c_str());
+                    bt->btree_delete(skey);
                 }
 
                 break;
@@ -445,7 +843,7 @@ template <typename K, typename V, int size> class Coordinator {
                 if (conf.key_type == Integer) {
                     bt->btree_search(d);
                 } else if (conf.key_type == String) {
-                    bt->btree_search((char *)s.c_str());
+                    bt->btree_search(skey);
                 }
 
                 // if (tx % 100 == 0) {
@@ -458,8 +856,7 @@ template <typename K, typename V, int size> class Coordinator {
                 int resultFound = 0;
                 //                std::cout<<"ff scan "<<s<<"\n";
                 // TODO
-                bt->btree_search_range((char *)s.c_str(),
-                                       (char *)maxkey.c_str(),
+                bt->btree_search_range(skey, (char *)maxkey.c_str(),
                                        (unsigned long *)buf, conf.scan_length,
                                        resultFound, scan_value);
 
@@ -471,6 +868,8 @@ template <typename K, typename V, int size> class Coordinator {
                 exit(-1);
             }
             }
+            if (hist != nullptr)
+                hist[op].record(rdtsc() - op_start);
             if (conf.latency_test) {
                 t.end();
                 while (t.duration() < submit_time) {
@@ -479,9 +878,20 @@ template <typename K, typename V, int size> class Coordinator {
                 }
             }
 
+#ifdef COUNT_PERSIST
+            persist_result->persist[op].add_delta(persist_counter, before);
+            persist_result->op_count[op]++;
+#endif
             tx++;
+#ifdef ACMA
+            quiescent(tx);
+#endif
         }
         result->throughput = tx;
+        if (perf != nullptr) {
+            result->perf = perf->stop();
+            delete perf;
+        }
         // printf("[%d] finish %d insert\n", workerid, count);
 
 #ifdef PERF_LATENCY
@@ -496,13 +906,23 @@ template <typename K, typename V, int size> class Coordinator {
         }
 #endif // PERF_LATENCY
 
+#ifdef ACMA
+        // the thread info is reused by the workers of the next phase
+        NVMMgr_ns::unregister_threadinfo();
+#endif
+        delete benchmark;
         printf("[WORKER]\tworker %d finished\n", workerid);
     }
 
     void sl_worker(skiplist::skiplist_t *sl, int workerid, Result *result,
                    Benchmark *b) {
-        //            Benchmark *benchmark = getBenchmark(conf);
+        // the operations come from a benchmark of this worker, freed when
+        // it finishes
         Benchmark *benchmark = getBenchmark(conf);
+        LatencyHistogram *hist = worker_histograms(workerid);
+        ArrivalSchedule schedule(conf.arrival,
+                                 (double)conf.throughput / conf.num_threads,
+                                 workerid);
         printf("[WORKER]\thello, I am worker %d\n", workerid);
         stick_this_thread_to_core(workerid);
 #ifdef ACMA
@@ -510,7 +930,12 @@ template <typename K, typename V, int size> class Coordinator {
 #else
         skiplist::register_thread();
 #endif
+        OpStream stream(benchmark, conf.key_type, stream_length());
+        PerfGroup *perf = perf_group();
         bar->wait();
+        schedule.start();
+        if (perf != nullptr)
+            perf->start();
 
         unsigned long tx = 0;
 
@@ -559,34 +984,32 @@ template <typename K, typename V, int size> class Coordinator {
         char *buf[505];
         char scan_value[val_len + 5];
 
+#ifdef COUNT_PERSIST
+        Result *persist_result = result; // result is shadowed in the loop
+#endif
+
         while (done == 0) {
 
             V result = 1;
-            long long d;
-            OperationType op;
-            std::string s;
-
-            if (conf.key_type == Integer) {
-                auto next_operation = benchmark->nextIntOperation();
-
-                op = next_operation.first;
-                d = next_operation.second;
-            } else if (conf.key_type == String) {
-                auto next_operation = benchmark->nextStrOperation();
-
-                op = next_operation.first;
-                s = next_operation.second;
-            }
+            const Operation &next_operation = stream.next();
+            OperationType op = next_operation.op;
+            long long d = next_operation.ikey;
+            char *skey = (char *)next_operation.skey.data;
 
             cpuCycleTimer t;
             if (conf.latency_test) {
                 t.start();
             }
 
+#ifdef COUNT_PERSIST
+            PersistCounter before = persist_counter;
+#endif
+            uint64_t op_start = schedule.open_loop() ? schedule.wait()
+                                : (hist != nullptr ? rdtsc() : 0);
             switch (op) {
             case UPDATE: {
 #ifdef VARIABLE_LENGTH
-                skiplist::skiplist_update(sl, (char *)s.c_str(), value);
+                skiplist::skiplist_update(sl, skey, value);
 #else
                 skiplist::skiplist_update(sl, d, d);
 #endif
@@ -594,7 +1017,7 @@ template <typename K, typename V, int size> class Coordinator {
             }
             case INSERT: {
 #ifdef VARIABLE_LENGTH
-                skiplist::skiplist_insert(sl, (char *)s.c_str(), value);
+                skiplist::skiplist_insert(sl, skey, value);
 //                skiplist::skiplist_remove(sl, (char *)s.c_str());
 #else
                 skiplist::skiplist_insert(sl, d, d);
@@ -604,7 +1027,7 @@ template <typename K, typename V, int size> class Coordinator {
             }
             case REMOVE: {
 #ifdef VARIABLE_LENGTH
-                skiplist::skiplist_remove(sl, (char *)s.c_str());
+                skiplist::skiplist_remove(sl, skey);
 #else
                 skiplist::skiplist_remove(sl, d);
 #endif
@@ -612,7 +1035,7 @@ template <typename K, typename V, int size> class Coordinator {
             }
             case GET: {
 #ifdef VARIABLE_LENGTH
-                skiplist::skiplist_find(sl, (char *)s.c_str());
+                skiplist::skiplist_find(sl, skey);
 #else
                 skiplist::skiplist_find(sl, d);
 #endif
@@ -621,9 +1044,8 @@ template <typename K, typename V, int size> class Coordinator {
             case SCAN: {
                 int resultFound = 0;
 #ifdef VARIABLE_LENGTH
-                skiplist::skiplist_scan(sl, (char *)s.c_str(), buf,
-                                        conf.scan_length, resultFound,
-                                        scan_value);
+                skiplist::skiplist_scan(sl, skey, buf, conf.scan_length,
+                                        resultFound, scan_value);
 #else
                 skiplist::skiplist_scan(sl, d, (uint64_t *)buf,
                                         conf.scan_length, resultFound,
@@ -637,6 +1059,8 @@ template <typename K, typename V, int size> class Coordinator {
                 exit(-1);
             }
             }
+            if (hist != nullptr)
+                hist[op].record(rdtsc() - op_start);
             if (conf.latency_test) {
                 t.end();
                 while (t.duration() < submit_time) {
@@ -645,9 +1069,20 @@ template <typename K, typename V, int size> class Coordinator {
                 }
             }
 
+#ifdef COUNT_PERSIST
+            persist_result->persist[op].add_delta(persist_counter, before);
+            persist_result->op_count[op]++;
+#endif
             tx++;
+#ifdef ACMA
+            quiescent(tx);
+#endif
         }
         result->throughput = tx;
+        if (perf != nullptr) {
+            result->perf = perf->stop();
+            delete perf;
+        }
         // printf("[%d] finish %d insert\n", workerid, count);
 
 #ifdef PERF_LATENCY
@@ -662,16 +1097,24 @@ template <typename K, typename V, int size> class Coordinator {
         }
 #endif // PERF_LATENCY
 
+#ifdef ACMA
+        // the thread info is reused by the workers of the next phase
+        NVMMgr_ns::unregister_threadinfo();
+#endif
+        delete benchmark;
         printf("[WORKER]\tworker %d finished\n", workerid);
     }
 
-#ifdef INSTANT_RESTART
+    // b is owned by this worker, it is built before the restart is timed
     void art_restart(PART_ns::Tree *art, int workerid, Benchmark *b) {
-        // Benchmark *benchmark = getBenchmark(conf);
-        Benchmark *benchmark = getBenchmark(conf);
+        Benchmark *benchmark = b;
+        LatencyHistogram *hist = worker_histograms(workerid);
         printf("[WORKER]\thello, I am worker %d\n", workerid);
         NVMMgr_ns::register_threadinfo();
         stick_this_thread_to_core(workerid);
+        // a pre-generated stream would delay the first operation after the
+        // restart
+        OpStream stream(benchmark, conf.key_type, 0);
         bar->wait();
 
         unsigned long tx = 0;
@@ -693,26 +1136,23 @@ template <typename K, typename V, int size> class Coordinator {
 
             V result = 1;
 
-            OperationType op;
-            long long d;
-            std::string s;
+            const Operation &next_operation = stream.next();
+            OperationType op = next_operation.op;
+            long long d = next_operation.ikey;
+            uint64_t ik = PART_ns::KeyCodec::order_u64(d);
 
             if (conf.key_type == Integer) {
-                auto next_operation = benchmark->nextIntOperation();
-                op = next_operation.first;
-                d = next_operation.second;
                 //                std::string s = std::to_string(d);
                 //                k->Init((char *)s.c_str(), s.size(), value,
                 //                val_len);
-                k->Init((char *)&d, sizeof(uint64_t), value, val_len);
+                k->Init((char *)&ik, sizeof(uint64_t), value, val_len);
             } else if (conf.key_type == String) {
-                auto next_operation = benchmark->nextStrOperation();
-                op = next_operation.first;
-                s = next_operation.second;
-                k->Init((char *)s.c_str(), s.size(), value, val_len);
+                k->Init((char *)next_operation.skey.data,
+                        next_operation.skey.len, value, val_len);
             }
 
             PART_ns::Tree::OperationResults res;
+            uint64_t op_start = hist != nullptr ? rdtsc() : 0;
             switch (op) {
             case UPDATE: {
 
@@ -745,65 +1185,736 @@ template <typename K, typename V, int size> class Coordinator {
                 exit(-1);
             }
             }
+            if (hist != nullptr)
+                hist[op].record(rdtsc() - op_start);
             increase(workerid);
+            tx++;
+            quiescent(tx);
         }
 
         unregister_threadinfo();
 
+        delete benchmark;
         printf("[WORKER]\tworker %d finished\n", workerid);
     }
 
-    void monitor_work(int thread_num) {
+    // print the throughput (and rolling percentiles) every interval seconds
+    void monitor_work(int thread_num, float interval) {
         bar->wait();
 
+        // rolling percentiles are the difference of two merged snapshots
+        HistogramSnapshot *pre = nullptr, *now = nullptr, *delta = nullptr;
+        if (histograms != nullptr) {
+            pre = new HistogramSnapshot[_OpreationTypeNumber];
+            now = new HistogramSnapshot[_OpreationTypeNumber];
+            delta = new HistogramSnapshot();
+        }
+
         uint64_t preans = 0;
         int second = 0;
-        timespec start, end;
         while (done == 0) {
-            //            clock_gettime(CLOCK_REALTIME, &start);
-            usleep(conf.duration * 1000000);
-            //            clock_gettime(CLOCK_REALTIME, &end);
-
-            //            double duration = end.tv_sec - start.tv_sec +
-            //            (end.tv_nsec - start.tv_nsec) / 1000000000.0;
-
-            uint64_t nowans = total(thread_num);
-            printf("second %d the throughput is %.2f Mop/s\n", second,
-                   (nowans - preans) / 1000000.0);
+            usleep(interval * 1000000);
+
+            uint64_t nowans = 0;
+            if (histograms != nullptr) {
+                merge_histograms(now);
+                for (int op = 0; op < _OpreationTypeNumber; op++)
+                    nowans += now[op].total;
+            } else {
+                nowans = total(thread_num);
+            }
+            double tp = (nowans - preans) / 1000000.0 / interval;
+            printf("second %d the throughput is %.2f Mop/s\n", second, tp);
+            interval_throughput.push_back(tp);
             preans = nowans;
+
+            if (histograms != nullptr) {
+                for (int op = 0; op < _OpreationTypeNumber; op++) {
+                    *delta = now[op];
+                    delta->subtract(pre[op]);
+                    if (delta->total > 0)
+                        delta->print("[INTERVAL]", operation_name(op));
+                }
+                std::swap(pre, now);
+            }
             second++;
         }
+        delete[] pre;
+        delete[] now;
+        delete delta;
     }
 
+#ifdef INSTANT_RESTART
     void instant_restart() {
+        timer restart_timer;
+        restart_timer.start();
         PART_ns::Tree *art = new PART_ns::Tree();
-        Benchmark *benchmark = getBenchmark(conf);
 
         std::thread **pid = new std::thread *[conf.num_threads];
+        alloc_histograms();
         bar = new boost::barrier(conf.num_threads + 2);
+        interval_throughput.clear();
+        init();
 
         for (int i = 0; i < conf.num_threads; i++) {
             pid[i] = new std::thread(&Coordinator::art_restart, this, art, i,
-                                     benchmark);
+                                     getBenchmark(conf));
         }
 
         std::thread *monitor =
-            new std::thread(&Coordinator::monitor_work, this, conf.num_threads);
+            new std::thread(&Coordinator::monitor_work, this, conf.num_threads,
+                            conf.duration);
+        go_offline();
         bar->wait();
-        NVMMgr *mgr = get_nvm_mgr();
-        mgr->recovery_free_memory(art, conf.num_threads);
 
-        sleep(100);
+        // repair the nodes of the last run in the background while serving
+        timer recovery_timer;
+        recovery_timer.start();
+        art->startRecovery(conf.recovery_threads);
+        art->waitRecovery();
+        recovery_timer.end();
+
+        // keep serving to get the steady throughput
+        const int steady_intervals = 5;
+        usleep(steady_intervals * conf.duration * 1000000);
+        done = 1;
         for (int i = 0; i < conf.num_threads; i++) {
             pid[i]->join();
         }
         monitor->join();
+        restart_timer.end();
+
+        // the steady throughput is the mean of the intervals after recovery,
+        // full throughput is reached at the first interval within 90% of it
+        std::vector<double> &tp = interval_throughput;
+        size_t recovered_intervals = (size_t)std::ceil(
+            recovery_timer.duration() / 1000000000.0 / conf.duration);
+        double steady = 0;
+        for (size_t i = recovered_intervals; i < tp.size(); i++)
+            steady += tp[i];
+        if (tp.size() > recovered_intervals)
+            steady /= tp.size() - recovered_intervals;
+        size_t full = 0;
+        while (full < tp.size() && tp[full] < 0.9 * steady)
+            full++;
+
+        printf("[RESTART]\tbackground recovery takes %.2lf ms with %d "
+               "threads\n",
+               recovery_timer.duration() / 1000000.0, conf.recovery_threads);
+        printf("[RESTART]\ttime to full throughput: %.2lf s, steady "
+               "throughput %.2lf Mop/s\n",
+               (full + 1) * conf.duration, steady);
+        print_latency();
 
         delete art;
         delete[] pid;
     }
 #endif
 
+    /*
+     * Recovery benchmark: a loader process fills the pool and is killed
+     * (SIGKILL) while updating, then a new process restarts the index from
+     * the same pool and reports its recovery phases to the parent. The
+     * parent copies the crashed pool right after the kill and restores that
+     * copy before every restart, since a restart changes the pool (garbage
+     * reclaimed, nodes repaired, generation bumped). Every strategy and
+     * thread count thus recovers the same crash state. The parent never
+     * maps the pool.
+     */
+    enum RecoveryStrategy { FULL_REBUILD, INSTANT, _RecoveryStrategyNumber };
+
+    struct RecoveryResult {
+        double open_ms;     // open and map the pool, collect the thread logs
+        double reclaim_ms;  // register a thread, free the logged garbage
+        double root_ms;     // attach the tree root
+        double repair_ms;   // full rebuild, or the background recovery
+        double first_op_ms; // first operation finished
+        double steady_ms;   // first window within 90% of steady throughput
+        double steady_tp;   // Mop/s after the repair
+    };
+
+    // fork a child running func(write end of a pipe), fd is the read end
+    template <typename F> pid_t fork_child(F func, int &fd) {
+        int p[2];
+        if (pipe(p) != 0) {
+            perror("[RECOVERY]\tpipe");
+            exit(1);
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("[RECOVERY]\tfork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(p[0]);
+            func(p[1]);
+            fflush(stdout);
+            _exit(0);
+        }
+        close(p[1]);
+        fd = p[0];
+        return pid;
+    }
+
+    static bool read_full(int fd, void *buf, size_t len) {
+        char *p = (char *)buf;
+        while (len > 0) {
+            ssize_t n = read(fd, p, len);
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // copy the data extents of a sparse pool file, the holes stay holes
+    static bool copy_pool(const char *from, const char *to) {
+        int in = open(from, O_RDONLY);
+        if (in < 0)
+            return false;
+        int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0) {
+            close(in);
+            return false;
+        }
+        off_t end = lseek(in, 0, SEEK_END);
+        bool ok = ftruncate(out, end) == 0;
+        const size_t chunk = 1 << 20;
+        char *buf = new char[chunk];
+        off_t data = lseek(in, 0, SEEK_DATA);
+        while (ok && data >= 0 && data < end) {
+            off_t hole = lseek(in, data, SEEK_HOLE);
+            if (hole < 0)
+                hole = end;
+            while (ok && data < hole) {
+                ssize_t n = pread(in, buf, std::min((off_t)chunk, hole - data),
+                                  data);
+                ok = n > 0 && pwrite(out, buf, n, data) == n;
+                data += n;
+            }
+            data = lseek(in, hole, SEEK_DATA);
+        }
+        delete[] buf;
+        ok = fsync(out) == 0 && ok;
+        close(in);
+        close(out);
+        return ok;
+    }
+
+    // child: load a new pool, keep updating and wait to be killed
+    void recovery_loader(int fd) {
+        system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+        PART_ns::Tree *art = new PART_ns::Tree();
+        Benchmark *benchmark = getBenchmark(conf);
+        art_load(art, benchmark);
+
+        init();
+        bar = new boost::barrier(conf.num_threads + 1);
+        for (int i = 0; i < conf.num_threads; i++) {
+            new std::thread(&Coordinator::art_restart, this, art, i,
+                            getBenchmark(conf));
+        }
+        go_offline();
+        bar->wait();
+
+        char loaded = 1;
+        write(fd, &loaded, sizeof(loaded));
+        while (true)
+            pause();
+    }
+
+    // child: restart from the crashed pool and serve until steady
+    void recovery_restart(RecoveryStrategy strategy, int threads, int fd) {
+        // the key sets are prepared before the clock starts
+        std::vector<Benchmark *> benchmarks;
+        for (int i = 0; i < conf.num_threads; i++)
+            benchmarks.push_back(getBenchmark(conf));
+
+        RecoveryResult r;
+        memset(&r, 0, sizeof(r));
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&start]() {
+            return std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                .count();
+        };
+
+        init_nvm_mgr();
+        double last = r.open_ms = elapsed();
+        register_threadinfo();
+        r.reclaim_ms = elapsed() - last;
+        last += r.reclaim_ms;
+        PART_ns::Tree *art = new PART_ns::Tree();
+        r.root_ms = elapsed() - last;
+        last += r.root_ms;
+
+        std::atomic<bool> repaired(true);
+        if (strategy == FULL_REBUILD) {
+            get_nvm_mgr()->recovery_free_memory(art, conf.num_threads,
+                                                threads);
+            r.repair_ms = elapsed() - last;
+        }
+
+        init();
+        bar = new boost::barrier(conf.num_threads + 1);
+        for (int i = 0; i < conf.num_threads; i++) {
+            new std::thread(&Coordinator::art_restart, this, art, i,
+                            benchmarks[i]);
+        }
+        go_offline();
+        bar->wait();
+
+        std::thread *waiter = nullptr;
+#ifdef INSTANT_RESTART
+        if (strategy == INSTANT) {
+            repaired.store(false);
+            double begin = elapsed();
+            art->startRecovery(threads);
+            waiter = new std::thread([&, begin]() {
+                art->waitRecovery();
+                r.repair_ms = elapsed() - begin;
+                repaired.store(true);
+            });
+        }
+#endif
+
+        while (total(conf.num_threads) == 0)
+            std::this_thread::yield();
+        r.first_op_ms = elapsed();
+
+        // sample the throughput until some windows after the repair
+        const double window = 0.1; // s
+        const int steady_windows = 10;
+        std::vector<std::pair<double, double>> windows; // (end ms, Mop/s)
+        size_t first_steady = 0;
+        int after = 0;
+        uint64_t pre = total(conf.num_threads);
+        while (after < steady_windows) {
+            bool was_repaired = repaired.load();
+            usleep(window * 1000000);
+            uint64_t now = total(conf.num_threads);
+            windows.push_back(
+                std::make_pair(elapsed(), (now - pre) / 1000000.0 / window));
+            pre = now;
+            if (was_repaired)
+                after++;
+            else
+                first_steady = windows.size();
+        }
+        for (size_t i = first_steady; i < windows.size(); i++)
+            r.steady_tp += windows[i].second;
+        r.steady_tp /= windows.size() - first_steady;
+        size_t full = 0;
+        while (windows[full].second < 0.9 * r.steady_tp)
+            full++;
+        r.steady_ms = windows[full].first;
+
+        if (waiter != nullptr)
+            waiter->join();
+        write(fd, &r, sizeof(r));
+        // crash while the workers are still running
+    }
+
+    void recovery_bench() {
+        if (conf.type != PART) {
+            printf("[RECOVERY]\tonly ART supports the recovery benchmark\n");
+            return;
+        }
+        // string keys come from a file shared by all processes, generate it
+        // with the largest size here
+        DataSet::open(conf.init_keys, conf.val_length, conf.key_shape);
+
+        std::vector<unsigned long long> sizes = {
+            conf.init_keys / 16, conf.init_keys / 4, conf.init_keys};
+        std::vector<int> recovery_threads;
+        for (int t = 1; t < conf.recovery_threads; t *= 2)
+            recovery_threads.push_back(t);
+        recovery_threads.push_back(conf.recovery_threads);
+        const char *strategy_name[] = {"rebuild", "instant"};
+#ifdef INSTANT_RESTART
+        const int strategies = _RecoveryStrategyNumber;
+#else
+        const int strategies = INSTANT;
+#endif
+
+        const std::string pool = std::string(nvm_dir) + "part.data";
+        const std::string crashed = pool + ".crashed";
+
+        Config origin = conf;
+        for (int kt = 0; kt < _KeyTypeNumber; kt++) {
+            for (unsigned long long keys : sizes) {
+                // children inherit the config of this process
+                conf.key_type = (KeyType)kt;
+                conf.init_keys = keys;
+
+                int fd;
+                pid_t loader = fork_child(
+                    [this](int wfd) { recovery_loader(wfd); }, fd);
+                char loaded;
+                bool ok = read_full(fd, &loaded, sizeof(loaded));
+                close(fd);
+                usleep(100000); // crash in the middle of the updates
+                kill(loader, SIGKILL);
+                waitpid(loader, nullptr, 0);
+                if (!ok) {
+                    printf("[RECOVERY]\tfail to load %llu keys\n", keys);
+                    continue;
+                }
+                if (!copy_pool(pool.c_str(), crashed.c_str())) {
+                    printf("[RECOVERY]\tfail to copy the crashed pool to "
+                           "%s\n",
+                           crashed.c_str());
+                    continue;
+                }
+
+                for (int s = 0; s < strategies; s++) {
+                    for (int t : recovery_threads) {
+                        RecoveryResult r;
+                        if (!copy_pool(crashed.c_str(), pool.c_str())) {
+                            printf("[RECOVERY]\tfail to restore the crashed "
+                                   "pool from %s\n",
+                                   crashed.c_str());
+                            continue;
+                        }
+                        pid_t restart = fork_child(
+                            [this, s, t](int wfd) {
+                                recovery_restart((RecoveryStrategy)s, t, wfd);
+                            },
+                            fd);
+                        ok = read_full(fd, &r, sizeof(r));
+                        close(fd);
+                        waitpid(restart, nullptr, 0);
+                        if (!ok) {
+                            printf("[RECOVERY]\t%s, %llu keys, %s, %d "
+                                   "threads: restart failed\n",
+                                   kt == Integer ? "Int" : "Str", keys,
+                                   strategy_name[s], t);
+                            continue;
+                        }
+                        printf("[RECOVERY]\t%s, %llu keys, %s, %d threads: "
+                               "open %.2lf ms, reclaim %.2lf ms, root %.2lf "
+                               "ms, repair %.2lf ms, first op %.2lf ms, "
+                               "steady %.2lf ms (%.2lf Mop/s)\n",
+                               kt == Integer ? "Int" : "Str", keys,
+                               strategy_name[s], t, r.open_ms, r.reclaim_ms,
+                               r.root_ms, r.repair_ms, r.first_op_ms,
+                               r.steady_ms, r.steady_tp);
+                    }
+                }
+            }
+        }
+        unlink(crashed.c_str());
+        conf = origin;
+    }
+
+    // run the workers on a loaded index for the duration, return the sum of
+    // their results
+    template <typename Index>
+    Result run_phase(void (Coordinator::*worker)(Index *, int, Result *,
+                                                 Benchmark *),
+                     Index *index, Benchmark *benchmark) {
+        Result *results = new Result[conf.num_threads];
+        std::thread **pid = new std::thread *[conf.num_threads];
+        done = 0;
+        alloc_histograms();
+        delete bar;
+        bar = new boost::barrier(barrier_count());
+
+        for (int i = 0; i < conf.num_threads; i++) {
+            pid[i] = new std::thread(worker, this, index, i, &results[i],
+                                     benchmark);
+        }
+
+        std::thread *monitor = start_monitor();
+        bar->wait();
+        usleep(conf.duration * 1000000);
+        done = 1;
+
+        Result final_result;
+        for (int i = 0; i < conf.num_threads; i++) {
+            pid[i]->join();
+            delete pid[i];
+            final_result += results[i];
+            printf("[WORKER]\tworker %d result %lf\n", i,
+                   results[i].throughput);
+        }
+        if (monitor != nullptr) {
+            monitor->join();
+            delete monitor;
+        }
+        delete[] pid;
+        delete[] results;
+        return final_result;
+    }
+
+    // latency of the open loop at rising offered load, from 10% of the
+    // closed loop throughput until the index can not keep up any more. Every
+    // step starts from the loaded keys, an index whose keys the workload
+    // changed is loaded again as in sweep_index
+    template <typename Index>
+    void load_sweep(Index *(Coordinator::*create)(),
+                    void (Coordinator::*load)(Index *, Benchmark *),
+                    bool (Coordinator::*destroy)(Index *),
+                    void (Coordinator::*worker)(Index *, int, Result *,
+                                                Benchmark *)) {
+        const int steps = 10;          // offered load in steps of 10% peak
+        const int max_steps = 15;      // beyond the closed loop peak
+        const double saturation = 0.95; // achieved / offered
+
+        Config origin = conf;
+        Index *index = nullptr;
+        auto phase = [&]() {
+            if (index != nullptr && changes_keys(conf.benchmark) &&
+                (this->*destroy)(index))
+                index = nullptr;
+            Benchmark *benchmark = getBenchmark(conf);
+            if (index == nullptr) {
+                index = (this->*create)();
+                (this->*load)(index, benchmark);
+                go_offline();
+            }
+            Result r = run_phase(worker, index, benchmark);
+            delete benchmark;
+            return r;
+        };
+
+        ArrivalType arrival = conf.arrival;
+        conf.arrival = CLOSED_LOOP;
+        Result closed = phase();
+        double peak = closed.throughput / conf.duration;
+        printf("[OPEN LOOP]\t%s, closed loop %.3lf Mop/s, %d threads\n",
+               index_name(), peak / 1000000.0, conf.num_threads);
+
+        conf.arrival = arrival;
+        HistogramSnapshot *s = new HistogramSnapshot[_OpreationTypeNumber];
+        for (int step = 1; step <= max_steps; step++) {
+            double offered = peak * step / steps;
+            conf.throughput = (int)offered;
+            Result r = phase();
+            double achieved = r.throughput / conf.duration;
+
+            merge_histograms(s);
+            for (int op = 1; op < _OpreationTypeNumber; op++)
+                s[0].add(s[op]);
+            printf("[OPEN LOOP]\t%s, %s, offered %.3lf Mop/s, achieved "
+                   "%.3lf Mop/s, p50 %.0lf ns, p99 %.0lf ns, p99.9 %.0lf ns, "
+                   "max %.0lf ns\n",
+                   index_name(), arrival == POISSON ? "Poisson" : "constant",
+                   offered / 1000000.0, achieved / 1000000.0,
+                   LatencyHistogram::to_ns(s[0].percentile(0.5)),
+                   LatencyHistogram::to_ns(s[0].percentile(0.99)),
+                   LatencyHistogram::to_ns(s[0].percentile(0.999)),
+                   LatencyHistogram::to_ns(s[0].max));
+            if (achieved < offered * saturation)
+                break;
+        }
+        delete[] s;
+        (this->*destroy)(index);
+        conf = origin;
+    }
+
+    const char *index_name() {
+        const char *name[_IndexTypeNumber] = {"ART", "FF", "SL"};
+        return name[conf.type];
+    }
+
+    // the load phase and the key type come from the trace
+    void prepare_trace() {
+        TraceFile *trace = TraceFile::open(conf.filename);
+        conf.init_keys = trace->load_count();
+        conf.key_type = trace->key_type();
+    }
+
+    // blocks taken from the pool of the nvm manager, -1 without the manager
+    long long pm_blocks() {
+        if (conf.type != PART && !dcmm_threadinfo())
+            return -1;
+        return get_nvm_mgr()->meta_data->free_bit_offset;
+    }
+
+    // a row of the -o file
+    void report(ResultWriter &writer, Result &r, long long blocks) {
+        typedef ResultWriter W;
+        HistogramSnapshot all;
+        if (histograms != nullptr) {
+            HistogramSnapshot *s = new HistogramSnapshot[_OpreationTypeNumber];
+            merge_histograms(s);
+            for (int op = 0; op < _OpreationTypeNumber; op++)
+                all.add(s[op]);
+            delete[] s;
+        }
+        std::vector<W::Field> f = {
+            W::str("index", index_name()),
+            W::str("key_type", (conf.key_type == Integer) ? "Int" : "Str"),
+            W::num("benchmark", conf.benchmark),
+            W::num("threads", conf.num_threads),
+            W::num("init_keys", conf.init_keys),
+            W::num("duration_s", conf.duration),
+            W::str("reclamation", reclamation_mode()),
+            W::str("pin", pin_policy_name(conf.pin)),
+            W::str("cpus", CpuTopology::get().describe(conf.pin,
+                                                       conf.num_threads)),
+            W::num("throughput_mops", r.throughput / conf.duration / 1000000.0),
+            W::num("ops", r.throughput),
+            W::num("p50_ns", LatencyHistogram::to_ns(all.percentile(0.5))),
+            W::num("p90_ns", LatencyHistogram::to_ns(all.percentile(0.9))),
+            W::num("p99_ns", LatencyHistogram::to_ns(all.percentile(0.99))),
+            W::num("p999_ns",
+                   LatencyHistogram::to_ns(all.percentile(0.999))),
+            W::num("max_ns", LatencyHistogram::to_ns(all.max)),
+            W::num("pm_blocks", blocks),
+        };
+        if (conf.perf_counters) {
+            // -1 for a counter which is not available
+            const PerfValues &p = r.perf;
+            double ops = r.throughput > 0 ? r.throughput : 1;
+            bool ipc = p.valid[PERF_CYCLES] && p.valid[PERF_INSTRUCTIONS] &&
+                       p.value[PERF_CYCLES] > 0;
+            f.push_back(W::num("ipc", ipc ? (double)p.value[PERF_INSTRUCTIONS] /
+                                                p.value[PERF_CYCLES]
+                                          : -1));
+            for (int e = 0; e < _PerfEventNumber; e++) {
+                std::string name = std::string(perf_event_name(e)) + "_per_op";
+                f.push_back(W::num(name.c_str(),
+                                   p.valid[e] ? p.value[e] / ops : -1));
+            }
+        }
+#ifdef COUNT_PERSIST
+        PersistCounter c;
+        memset(&c, 0, sizeof(c));
+        long long n = 0;
+        for (int op = 0; op < _OpreationTypeNumber; op++) {
+            c += r.persist[op];
+            n += r.op_count[op];
+        }
+        if (n == 0)
+            n = 1;
+        f.push_back(W::num("clwb_per_op", (double)c.clwb / n));
+        f.push_back(W::num("clflush_per_op", (double)c.clflush / n));
+        f.push_back(W::num("fence_per_op", (double)c.fence / n));
+        f.push_back(W::num("flush_bytes_per_op", (double)c.flush_bytes / n));
+        f.push_back(W::num("pm_block_per_op", (double)c.pm_block / n));
+        f.push_back(W::num("gc_free_per_op", (double)c.gc_free / n));
+        f.push_back(W::num("help_flush_per_op", (double)c.help_flush / n));
+#endif
+        writer.row(f);
+        printf("[SWEEP]\t%s, %s, benchmark %d, %d threads, %.3lf Mop/s, p50 "
+               "%.0lf ns, p99 %.0lf ns, p99.9 %.0lf ns, %lld pm blocks\n",
+               index_name(), (conf.key_type == Integer) ? "Int" : "Str",
+               conf.benchmark, conf.num_threads,
+               r.throughput / conf.duration / 1000000.0,
+               LatencyHistogram::to_ns(all.percentile(0.5)),
+               LatencyHistogram::to_ns(all.percentile(0.99)),
+               LatencyHistogram::to_ns(all.percentile(0.999)), blocks);
+        print_perf("run", r.perf, r.throughput);
+    }
+
+    // the initial keys of a benchmark, runs with the same initial keys can
+    // share a loaded index
+    static int initial_keys_of(int benchmark) {
+        if (benchmark == TRACE_BENCH)
+            return 2;
+#ifndef INSERT_DUP
+        if (benchmark == INSERT_ONLY)
+            return 1; // integer keys are scaled
+#endif
+        return 0;
+    }
+
+    static bool changes_keys(int benchmark) {
+        return benchmark == INSERT_ONLY || benchmark == DELETE_ONLY ||
+               benchmark == YCSB_A || benchmark == YCSB_B ||
+               benchmark == YCSB_D || benchmark == YCSB_E ||
+               benchmark == TRACE_BENCH;
+    }
+
+    template <typename Index>
+    void sweep_index(Index *(Coordinator::*create)(),
+                     void (Coordinator::*load)(Index *, Benchmark *),
+                     bool (Coordinator::*destroy)(Index *),
+                     void (Coordinator::*worker)(Index *, int, Result *,
+                                                 Benchmark *),
+                     const std::vector<int> &benchmarks,
+                     const std::vector<int> &threads, ResultWriter &writer) {
+        Index *index = nullptr;
+        int loaded = -1;
+        for (int b : benchmarks) {
+            if (b == RECOVERY_BENCH || b < 0 || b >= _BenchMarkType) {
+                printf("[SWEEP]\tskip benchmark %d\n", b);
+                continue;
+            }
+            conf.benchmark = (BenchMarkType)b;
+            if (b == TRACE_BENCH)
+                prepare_trace();
+            for (int t : threads) {
+                conf.num_threads = t;
+                if (index != nullptr && loaded != initial_keys_of(b) &&
+                    (this->*destroy)(index))
+                    index = nullptr;
+                Benchmark *benchmark = getBenchmark(conf);
+                if (index == nullptr) {
+                    index = (this->*create)();
+                    (this->*load)(index, benchmark);
+                    go_offline();
+                    loaded = initial_keys_of(b);
+                }
+
+                long long blocks = pm_blocks();
+                Result r = run_phase(worker, index, benchmark);
+                if (blocks >= 0)
+                    blocks = pm_blocks() - blocks;
+                report(writer, r, blocks);
+                delete benchmark;
+
+                if (changes_keys(b) && (this->*destroy)(index))
+                    index = nullptr;
+            }
+        }
+        if (index != nullptr)
+            (this->*destroy)(index);
+    }
+
+    // every combination of index types, benchmarks and thread counts in one
+    // process, a loaded index is reused until a run changes its keys
+    void sweep() {
+        std::vector<int> types = conf.sweep_types;
+        std::vector<int> benchmarks = conf.sweep_benchmarks;
+        std::vector<int> threads = conf.sweep_threads;
+        if (types.empty())
+            types.push_back(conf.type);
+        if (benchmarks.empty())
+            benchmarks.push_back(conf.benchmark);
+        if (threads.empty())
+            threads.push_back(conf.num_threads);
+        conf.histogram = true;
+        print_cpu_map(*std::max_element(threads.begin(), threads.end()));
+        ResultWriter writer(conf.output);
+
+        for (int type : types) {
+            conf.type = (IndexType)type;
+            if (conf.type == PART) {
+                sweep_index(&Coordinator::art_create, &Coordinator::art_load,
+                            &Coordinator::art_destroy,
+                            &Coordinator::art_worker, benchmarks, threads,
+                            writer);
+            } else if (conf.type == FAST_FAIR) {
+                sweep_index(&Coordinator::ff_create, &Coordinator::ff_load,
+                            &Coordinator::dcmm_destroy<fastfair::btree>,
+                            &Coordinator::ff_worker, benchmarks, threads,
+                            writer);
+            } else if (conf.type == SKIPLIST) {
+                sweep_index(&Coordinator::sl_create, &Coordinator::sl_load,
+                            &Coordinator::dcmm_destroy<skiplist::skiplist_t>,
+                            &Coordinator::sl_worker, benchmarks, threads,
+                            writer);
+            } else {
+                printf("[SWEEP]\tskip index type %d\n", type);
+            }
+        }
+    }
+
     void run() {
         printf("[COORDINATOR]\tStart benchmark..\n");
 #ifdef INSTANT_RESTART
@@ -813,150 +1924,75 @@ template <typename K, typename V, int size> class Coordinator {
             return;
         }
 #endif
+        if (conf.sweep() && !conf.load_sweep) {
+            sweep();
+            return;
+        }
+        print_cpu_map(conf.num_threads);
+        if (conf.benchmark == RECOVERY_BENCH) {
+            recovery_bench();
+            return;
+        }
+        if (conf.benchmark == TRACE_BENCH)
+            prepare_trace();
+        if (conf.load_sweep) {
+            if (conf.type == PART)
+                load_sweep(&Coordinator::art_create, &Coordinator::art_load,
+                           &Coordinator::art_destroy, &Coordinator::art_worker);
+            else if (conf.type == FAST_FAIR)
+                load_sweep(&Coordinator::ff_create, &Coordinator::ff_load,
+                           &Coordinator::dcmm_destroy<fastfair::btree>,
+                           &Coordinator::ff_worker);
+            else if (conf.type == SKIPLIST)
+                load_sweep(&Coordinator::sl_create, &Coordinator::sl_load,
+                           &Coordinator::dcmm_destroy<skiplist::skiplist_t>,
+                           &Coordinator::sl_worker);
+            return;
+        }
 
         if (conf.type == PART) {
             // ART
             printf("test ART---------------------\n");
-            PART_ns::Tree *art = new PART_ns::Tree();
+            PART_ns::Tree *art = art_create();
             Benchmark *benchmark = getBenchmark(conf);
 
-            Result *results = new Result[conf.num_threads];
-            memset(results, 0, sizeof(Result) * conf.num_threads);
-
-            std::thread **pid = new std::thread *[conf.num_threads];
-            bar = new boost::barrier(conf.num_threads + 1);
             std::cout << "start\n";
-            PART_ns::Key *k = new PART_ns::Key();
-            printf("init keys: %d\n", (int)conf.init_keys);
-            // variable value
-            const int val_len = conf.val_length;
-            char value[val_len + 5];
-            memset(value, 'a', val_len);
-            value[val_len] = 0;
-
-            for (unsigned long i = 0; i < conf.init_keys; i++) {
-                if (conf.key_type == Integer) {
-                    long long kk = benchmark->nextInitIntKey();
-                    //                    std::string s = std::to_string(kk);
-                    //                    k->Init((char *)s.c_str(), s.size(),
-                    //                    value, val_len);
-                    k->Init((char *)&kk, sizeof(long long), value, val_len);
-                    art->insert(k);
-                } else if (conf.key_type == String) {
-                    std::string s = benchmark->nextInitStrKey();
-                    k->Init((char *)s.c_str(), s.size(), value, val_len);
-                    art->insert(k);
-                }
-            }
-            printf("init insert finished\n");
-            if (conf.benchmark == RECOVERY_BENCH) {
-                NVMMgr *mgr = get_nvm_mgr();
-
-                timer t;
-                t.start();
-                mgr->recovery_free_memory(art, 1);
-                t.end();
-                printf("rebuild takes time: %.2lf ms\n",
-                       t.duration() / 1000000.0);
-                return;
-            }
+            art_load(art, benchmark);
+            go_offline();
 
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i] = new std::thread(&Coordinator::art_worker, this, art, i,
-                                         &results[i], benchmark);
-            }
-
-            bar->wait();
-            usleep(conf.duration * 1000000);
-            done = 1;
-
-            Result final_result;
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i]->join();
-                final_result += results[i];
-                printf("[WORKER]\tworker %d result %lf\n", i,
-                       results[i].throughput);
-            }
+            Result final_result =
+                run_phase(&Coordinator::art_worker, art, benchmark);
 
             printf("[COORDINATOR]\tFinish benchmark..\n");
             printf("[RESULT]\ttotal throughput: %.3lf Mtps, %d threads, %s, "
                    "%s, benchmark %d, zipfian %.2lf, rr is %d, read latency is "
                    "%.3lf ns， read op count is %d, help count is %d, "
-                   "writecount is %d\n",
+                   "writecount is %d, %s reclamation\n",
                    (double)final_result.throughput / 1000000.0 / conf.duration,
                    conf.num_threads, (conf.type == PART) ? "ART" : "FF",
                    (conf.key_type == Integer) ? "Int" : "Str", conf.benchmark,
                    (conf.workload == RANDOM) ? 0 : conf.skewness,
                    conf.read_ratio, final_result.total / final_result.count,
                    final_result.count, final_result.helpcount,
-                   final_result.writecount);
+                   final_result.writecount, reclamation_mode());
+            print_latency();
+            print_perf("run", final_result.perf, final_result.throughput);
+#ifdef COUNT_PERSIST
+            print_persist(final_result);
+#endif
 
             delete art;
-            delete[] pid;
-            delete[] results;
         }
         else if (conf.type == FAST_FAIR) {
             // FAST_FAIR
             printf("test FAST_FAIR---------------------\n");
-#ifdef USE_PMDK
-
-#ifdef ACMA
-            fastfair::btree *bt = new fastfair::btree();
-            std::cout << "[FF]\tcreate fastfair with DCMM\n";
-#else
-            fastfair::init_pmem();
-            fastfair::btree *bt =
-                new (fastfair::allocate(sizeof(fastfair::btree)))
-                    fastfair::btree();
-            std::cout << "[FF]\tPM create tree\n";
-#endif
-
-#else
-            fastfair::btree *bt = new fastfair::btree();
-            std::cout << "[FF]\tmemory create tree\n";
-#endif
+            fastfair::btree *bt = ff_create();
             Benchmark *benchmark = getBenchmark(conf);
+            ff_load(bt, benchmark);
+            go_offline();
 
-            Result *results = new Result[conf.num_threads];
-            memset(results, 0, sizeof(Result) * conf.num_threads);
-
-            std::thread **pid = new std::thread *[conf.num_threads];
-            bar = new boost::barrier(conf.num_threads + 1);
-            printf("init keys: %d\n", (int)conf.init_keys);
-
-            const int val_len = conf.val_length;
-            char value[val_len + 5];
-            memset(value, 'a', val_len);
-            value[val_len] = 0;
-            for (unsigned long i = 0; i < conf.init_keys; i++) {
-                if (conf.key_type == Integer) {
-                    long kk = benchmark->nextInitIntKey();
-                    bt->btree_insert(kk, value);
-                    //                    std::cout << "insert key " << kk <<
-                    //                    "id: " << i << "\n";
-                } else if (conf.key_type == String) {
-                    std::string s = benchmark->nextInitStrKey();
-                    bt->btree_insert((char *)s.c_str(), value);
-                }
-            }
-            printf("init insert finished\n");
-
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i] = new std::thread(&Coordinator::ff_worker, this, bt, i,
-                                         &results[i], benchmark);
-            }
-
-            bar->wait();
-            usleep(conf.duration * 1000000);
-            done = 1;
-
-            Result final_result;
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i]->join();
-                final_result += results[i];
-                printf("[WORKER]\tworker %d result %lf\n", i,
-                       results[i].throughput);
-            }
+            Result final_result =
+                run_phase(&Coordinator::ff_worker, bt, benchmark);
 
             printf("[COORDINATOR]\tFinish benchmark..\n");
             printf("[RESULT]\ttotal throughput: %.3lf Mtps, %d threads, %s, "
@@ -966,68 +2002,21 @@ template <typename K, typename V, int size> class Coordinator {
                    (conf.key_type == Integer) ? "Int" : "Str", conf.benchmark,
                    (conf.workload == RANDOM) ? 0 : conf.skewness,
                    conf.read_ratio);
-
-            delete[] pid;
-            delete[] results;
+            print_latency();
+            print_perf("run", final_result.perf, final_result.throughput);
+#ifdef COUNT_PERSIST
+            print_persist(final_result);
+#endif
         }
         else if (conf.type == SKIPLIST) {
             printf("test skiplist\n");
-#ifdef ACMA
-#else
-
-            skiplist::init_pmem();
-#endif
-            skiplist::skiplist_t *sl = skiplist::new_skiplist();
-            printf("skiplist create\n");
-
+            skiplist::skiplist_t *sl = sl_create();
             Benchmark *benchmark = getBenchmark(conf);
+            sl_load(sl, benchmark);
+            go_offline();
 
-            Result *results = new Result[conf.num_threads];
-            memset(results, 0, sizeof(Result) * conf.num_threads);
-
-            std::thread **pid = new std::thread *[conf.num_threads];
-            bar = new boost::barrier(conf.num_threads + 1);
-            printf("init keys: %d\n", (int)conf.init_keys);
-
-            const int val_len = conf.val_length;
-            char value[val_len + 5];
-            memset(value, 'a', val_len);
-            value[val_len] = 0;
-
-            for (unsigned long i = 0; i < conf.init_keys; i++) {
-                long long kk;
-                std::string s;
-                if (conf.key_type == Integer) {
-                    kk = benchmark->nextInitIntKey();
-                    //                    std::cout << "insert key " << kk <<
-                    //                    "id: " << i << "\n";
-                } else if (conf.key_type == String) {
-                    s = benchmark->nextInitStrKey();
-                }
-#ifdef VARIABLE_LENGTH
-                skiplist::skiplist_insert(sl, (char *)s.c_str(), value);
-#else
-                skiplist::skiplist_insert(sl, kk, kk);
-#endif
-            }
-            printf("init insert finished\n");
-
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i] = new std::thread(&Coordinator::sl_worker, this, sl, i,
-                                         &results[i], benchmark);
-            }
-
-            bar->wait();
-            usleep(conf.duration * 1000000);
-            done = 1;
-
-            Result final_result;
-            for (int i = 0; i < conf.num_threads; i++) {
-                pid[i]->join();
-                final_result += results[i];
-                printf("[WORKER]\tworker %d result %lf\n", i,
-                       results[i].throughput);
-            }
+            Result final_result =
+                run_phase(&Coordinator::sl_worker, sl, benchmark);
 
             printf("[COORDINATOR]\tFinish benchmark..\n");
             printf("[RESULT]\ttotal throughput: %.3lf Mtps, %d threads, %s, "
@@ -1037,9 +2026,11 @@ template <typename K, typename V, int size> class Coordinator {
                    (conf.key_type == Integer) ? "Int" : "Str", conf.benchmark,
                    (conf.workload == RANDOM) ? 0 : conf.skewness,
                    conf.read_ratio);
-
-            delete[] pid;
-            delete[] results;
+            print_latency();
+            print_perf("run", final_result.perf, final_result.throughput);
+#ifdef COUNT_PERSIST
+            print_persist(final_result);
+#endif
         }
 
 #ifdef PERF_LATENCY
@@ -1065,6 +2056,10 @@ template <typename K, typename V, int size> class Coordinator {
     Config conf __attribute__((aligned(64)));
     volatile int done __attribute__((aligned(64))) = 0;
     boost::barrier *bar __attribute__((aligned(64))) = 0;
+    // throughput of every monitor interval
+    std::vector<double> interval_throughput;
+    // num_threads * _OpreationTypeNumber histograms if enabled
+    LatencyHistogram *histograms = nullptr;
 };
 
 #endif
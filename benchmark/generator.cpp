@@ -3,6 +3,8 @@
 
 std::mutex ZipfWrapper::gen_mtx;
 std::map<std::string, WorkloadFile *> ZipfWrapper::wf_map;
+std::mutex DataSet::ds_mtx;
+std::map<std::string, DataSet *> DataSet::ds_map;
 
 std::mutex dataset_mtx;
 
@@ -92,9 +94,133 @@ ZipfWrapper::ZipfWrapper(double s, int inital) {
     gen_mtx.unlock();
 }
 
-DataSet::DataSet(int size, int key_length, int email)
-    : data_size(size), key_len(key_length), emailkey(email) {
-    if (emailkey == 0) { // rand string key
+DataSet *DataSet::open(int size, int key_length, KeyShape shape) {
+    std::stringstream ss;
+    ss << size << "_" << key_length << "_" << shape;
+    std::lock_guard<std::mutex> lock(ds_mtx);
+    auto it = ds_map.find(ss.str());
+    if (it != ds_map.end())
+        return it->second;
+    DataSet *ds = new DataSet(size, key_length, shape);
+    ds_map[ss.str()] = ds;
+    return ds;
+}
+
+void DataSet::load(std::ifstream &fstr) {
+    std::vector<char> buf;
+    std::string s;
+    offsets = new uint64_t[data_size + 1];
+    for (int i = 0; i < data_size; i++) {
+        offsets[i] = buf.size();
+        fstr >> s;
+        buf.insert(buf.end(), s.begin(), s.end());
+        buf.push_back('\0');
+    }
+    offsets[data_size] = buf.size();
+    arena = new char[buf.size()];
+    memcpy(arena, buf.data(), buf.size());
+}
+
+void DataSet::generate() {
+    std::vector<char> buf;
+    offsets = new uint64_t[data_size + 1];
+    for (int i = 0; i < data_size; i++) {
+        offsets[i] = buf.size();
+        std::string s = shaped_key(key_shape, i);
+        buf.insert(buf.end(), s.begin(), s.end());
+        buf.push_back('\0');
+    }
+    offsets[data_size] = buf.size();
+    arena = new char[buf.size()];
+    memcpy(arena, buf.data(), buf.size());
+}
+
+// a bijection of 64 bit integers, the finalizer of splitmix64
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+template <size_t N>
+static inline const char *pick(const char *const (&words)[N], uint64_t h) {
+    return words[h % N];
+}
+
+std::string shaped_key(KeyShape shape, uint64_t i) {
+    static const char *const firsts[] = {
+        "james", "mary",  "robert", "patricia", "john",   "jennifer",
+        "wei",   "fang",  "li",     "yan",      "carlos", "maria",
+        "ahmed", "fatma", "hiroshi", "yuki"};
+    static const char *const lasts[] = {
+        "smith", "johnson", "williams", "brown", "wang", "zhang",
+        "chen",  "garcia",  "lopez",    "ali",   "sato", "tanaka"};
+    static const char *const domains[] = {
+        "gmail.com", "yahoo.com",   "outlook.com", "qq.com",
+        "163.com",   "example.org", "tsinghua.edu.cn"};
+    static const char *const sections[] = {
+        "books", "electronics", "home-garden", "sports", "toys", "fashion"};
+    static const char *const categories[] = {
+        "new-arrivals", "best-sellers", "deals", "clearance", "featured"};
+
+    uint64_t h = mix64(i);
+    char buf[256];
+    int n = 0;
+    switch (shape) {
+    case EMAIL_KEY:
+        // i keeps the local part unique, '@' ends it
+        n = snprintf(buf, sizeof(buf), "%s.%s%llu@%s", pick(firsts, h),
+                     pick(lasts, h >> 8), (unsigned long long)i,
+                     pick(domains, h >> 16));
+        break;
+    case URL_KEY:
+        // every path segment ends with '/', the item id has a fixed width
+        n = snprintf(buf, sizeof(buf),
+                     "https://www.shop.example.com/catalog/%s/%s/item/%016llx",
+                     pick(sections, h), pick(categories, h >> 8),
+                     (unsigned long long)h);
+        break;
+    case COMPOSITE_KEY:
+        n = snprintf(buf, sizeof(buf), "tenant%04llu|table%02llu|%012llu",
+                     (unsigned long long)(h % 1000),
+                     (unsigned long long)((h >> 16) % 32),
+                     (unsigned long long)i);
+        break;
+    case TIMESTAMP_KEY:
+        // microseconds from 2024-01-01, 1 to 15 apart
+        n = snprintf(buf, sizeof(buf), "%016llu",
+                     (unsigned long long)(1704067200000000ULL + i * 8 +
+                                          (h & 7)));
+        break;
+    case LONG_KEY: {
+        n = snprintf(buf, sizeof(buf),
+                     "/warehouse/region-%02llu/customer-records/partition-"
+                     "%04llu/%016llx/",
+                     (unsigned long long)(h % 16),
+                     (unsigned long long)((h >> 8) % 1024),
+                     (unsigned long long)h);
+        // a tail of letters up to 72..135 bytes
+        int len = 72 + (int)((h >> 32) % 64);
+        uint64_t r = h;
+        while (n < len) {
+            r = mix64(r);
+            buf[n++] = 'a' + r % 26;
+        }
+        buf[n] = '\0';
+        break;
+    }
+    default:
+        // fixed width digits
+        n = snprintf(buf, sizeof(buf), "%020llu", (unsigned long long)h);
+        break;
+    }
+    return std::string(buf, n);
+}
+
+DataSet::DataSet(int size, int key_length, KeyShape shape)
+    : data_size(size), key_len(key_length), key_shape(shape) {
+    std::string email_key_file = "/tmp/email_key";
+    if (key_shape == DIGIT_KEY) { // rand string key
         std::string fn_str = get_file_name_str(key_len);
         dataset_mtx.lock();
         if (access(fn_str.c_str(), 0)) {
@@ -111,25 +237,25 @@ DataSet::DataSet(int size, int key_length, int email)
 
         std::cout << "start to load data\n";
         std::ifstream fstr;
-        wl_str = new std::string[data_size];
         fstr.open(fn_str, std::ios::in);
-        for (int i = 0; i < data_size; i++) {
-            fstr >> wl_str[i];
-        }
+        load(fstr);
         fstr.close();
         dataset_mtx.unlock();
         std::cout << "load random string key successfully\n";
-    } else { // email key
-        std::string email_key_file = "/tmp/email_key";
+    } else if (key_shape == EMAIL_KEY &&
+               access(email_key_file.c_str(), 0) == 0) {
         dataset_mtx.lock();
         std::ifstream fstr;
-        wl_str = new std::string[data_size];
         fstr.open(email_key_file, std::ios::in);
-        for (int i = 0; i < data_size; i++) {
-            fstr >> wl_str[i];
-        }
+        load(fstr);
         fstr.close();
         dataset_mtx.unlock();
         std::cout << "load string data successfully\n";
+    } else {
+        generate();
+        std::cout << "generate " << data_size << " "
+                  << key_shape_name(key_shape) << " keys, "
+                  << (offsets[data_size] - data_size) / std::max(data_size, 1)
+                  << " bytes on average\n";
     }
 }
@@ -110,12 +110,50 @@ class ZipfWrapper : public WorkloadGenerator {
     long long Next() { return wf->get(cursor++); }
 };
 
+// a key which lives in some arena, not owned
+struct KeyView {
+    const char *data;
+    int len;
+
+    KeyView() : data(""), len(0) {}
+    KeyView(const char *d, int l) : data(d), len(l) {}
+};
+
+// the global swap of microbench.h and std::swap are both found for sorting
+inline void swap(KeyView &a, KeyView &b) {
+    KeyView tmp = a;
+    a = b;
+    b = tmp;
+}
+
+/*
+ * Deterministic string key i of a shape
+ *
+ * Key i is a function of i only and different keys are never equal or a
+ * prefix of each other, so every run and every index gets the same keys.
+ */
+std::string shaped_key(KeyShape shape, uint64_t i);
+
+/*
+ * String keys of the workloads
+ *
+ * All keys are stored back to back in one arena, every key ends with a '\0'.
+ * A data set is loaded once and shared by all benchmarks of the same size.
+ */
 class DataSet {
+    static std::mutex ds_mtx;
+    static std::map<std::string, DataSet *> ds_map;
+
+    char *arena;
+    uint64_t *offsets; // data_size + 1, key i is [offsets[i], offsets[i+1])
+
+    void load(std::ifstream &fstr);
+    void generate();
+
   public:
-    std::string *wl_str;
     int data_size;
     int key_len;
-    int emailkey;
+    KeyShape key_shape;
 
     static std::string get_file_name_str(int len) {
         std::stringstream ss;
@@ -123,7 +161,18 @@ class DataSet {
         return "/tmp/random_str_data" + ss.str();
     }
 
-    DataSet(int size, int key_length, int email);
+    static DataSet *open(int size, int key_length, KeyShape shape);
+
+    DataSet(int size, int key_length, KeyShape shape);
+    ~DataSet() {
+        delete[] arena;
+        delete[] offsets;
+    }
+
+    inline KeyView get(long long i) const {
+        return KeyView(arena + offsets[i],
+                       (int)(offsets[i + 1] - offsets[i] - 1));
+    }
 };
 
 #endif // GENERATOR_H
\ No newline at end of file
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "util.h"
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+
+/*
+ * Log-bucketed latency histogram in the HDR style
+ *
+ * Values are tsc cycles, converted to ns with the rate measured by
+ * cycles_per_ns(), the clock the open-loop arrivals are scheduled with.
+ * Values below 2^sub_bits have their own bucket,
+ * every larger power of two is split into 2^sub_bits buckets, so a value is
+ * reported with less than 1/2^sub_bits relative error.
+ *
+ * A histogram has exactly one writer (the worker thread), the counters are
+ * atomics with relaxed order so that the monitor thread can read a rolling
+ * snapshot while the worker records without any lock.
+ */
+class LatencyHistogram {
+  public:
+    static const int sub_bits = 4;
+    static const int sub_buckets = 1 << sub_bits;
+    static const int bucket_num = (64 - sub_bits + 1) * sub_buckets;
+
+    static inline int bucket_of(uint64_t v) {
+        if (v < (uint64_t)sub_buckets)
+            return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        int sub = (int)(v >> (e - sub_bits)) & (sub_buckets - 1);
+        return (e - sub_bits + 1) * sub_buckets + sub;
+    }
+
+    // the largest value of a bucket
+    static inline uint64_t value_of(int bucket) {
+        if (bucket < sub_buckets)
+            return bucket;
+        int e = bucket / sub_buckets + sub_bits - 1;
+        uint64_t sub = bucket % sub_buckets;
+        return ((sub_buckets + sub + 1) << (e - sub_bits)) - 1;
+    }
+
+    // the tsc is measured against the wall clock once, CPU_FREQUENCY is only
+    // the nominal rate of one machine
+    static double cycles_per_ns() {
+        static double freq = []() {
+            auto t0 = std::chrono::steady_clock::now();
+            uint64_t c0 = rdtsc();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            uint64_t c1 = rdtsc();
+            auto t1 = std::chrono::steady_clock::now();
+            return (double)(c1 - c0) /
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
+                       .count();
+        }();
+        return freq;
+    }
+
+    static inline double to_ns(double cycles) {
+        return cycles / cycles_per_ns();
+    }
+
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        for (int i = 0; i < bucket_num; i++)
+            counts[i].store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    // only called by the owner thread
+    inline void record(uint64_t v) {
+        std::atomic<uint64_t> &c = counts[bucket_of(v)];
+        c.store(c.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        if (v > max.load(std::memory_order_relaxed))
+            max.store(v, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts[bucket_num];
+    std::atomic<uint64_t> max;
+};
+
+// a plain copy of histograms to merge, subtract and get percentiles
+class HistogramSnapshot {
+  public:
+    uint64_t counts[LatencyHistogram::bucket_num];
+    uint64_t total;
+    uint64_t max;
+
+    HistogramSnapshot() { clear(); }
+
+    void clear() {
+        memset(counts, 0, sizeof(counts));
+        total = max = 0;
+    }
+
+    void add(const LatencyHistogram &h) {
+        for (int i = 0; i < LatencyHistogram::bucket_num; i++) {
+            uint64_t c = h.counts[i].load(std::memory_order_relaxed);
+            counts[i] += c;
+            total += c;
+        }
+        uint64_t m = h.max.load(std::memory_order_relaxed);
+        if (m > max)
+            max = m;
+    }
+
+    void add(const HistogramSnapshot &s) {
+        for (int i = 0; i < LatencyHistogram::bucket_num; i++)
+            counts[i] += s.counts[i];
+        total += s.total;
+        if (s.max > max)
+            max = s.max;
+    }
+
+    // the values recorded since the older snapshot, max is estimated from
+    // the highest bucket
+    void subtract(const HistogramSnapshot &older) {
+        max = 0;
+        total = 0;
+        for (int i = 0; i < LatencyHistogram::bucket_num; i++) {
+            counts[i] -= older.counts[i];
+            total += counts[i];
+            if (counts[i] != 0)
+                max = LatencyHistogram::value_of(i);
+        }
+    }
+
+    // p in [0, 1]
+    uint64_t percentile(double p) const {
+        if (total == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(p * total);
+        if (rank >= total)
+            rank = total - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < LatencyHistogram::bucket_num; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint64_t v = LatencyHistogram::value_of(i);
+                return v < max ? v : max;
+            }
+        }
+        return max;
+    }
+
+    // total latency in cycles, every value is taken as its bucket value
+    double sum() const {
+        double s = 0;
+        for (int i = 0; i < LatencyHistogram::bucket_num; i++)
+            s += (double)counts[i] * LatencyHistogram::value_of(i);
+        return s;
+    }
+
+    void print(const char *tag, const char *name) const {
+        printf("%s\t%s: %llu ops, p50 %.0lf ns, p90 %.0lf ns, p99 %.0lf ns, "
+               "p99.9 %.0lf ns, max %.0lf ns\n",
+               tag, name, (unsigned long long)total,
+               LatencyHistogram::to_ns(percentile(0.5)),
+               LatencyHistogram::to_ns(percentile(0.9)),
+               LatencyHistogram::to_ns(percentile(0.99)),
+               LatencyHistogram::to_ns(percentile(0.999)),
+               LatencyHistogram::to_ns(max));
+    }
+};
@@ -3,19 +3,11 @@
 
 #include "config.h"
 #include "generator.h"
+#include "trace.h"
 #include "util.h"
 #include <assert.h>
 #include <utility>
-
-enum OperationType {
-    INSERT,
-    REMOVE,
-    UPDATE,
-    GET,
-    SCAN,
-    MIXED,
-    _OpreationTypeNumber
-};
+#include <vector>
 
 template <typename T> inline void swap(T &a, T &b) {
     T tmp = a;
@@ -43,13 +35,20 @@ class Benchmark {
     Config _conf;
     DataSet *dataset;
     RandomGenerator rdm;
-
-    Benchmark(Config &conf) : init_key(0), _conf(conf) {
-        dataset = new DataSet(conf.init_keys, conf.val_length, conf.email);
-        if (conf.workload == RANDOM) {
-            workload = new RandomGenerator();
-        } else if (conf.workload == ZIPFIAN) {
-            workload = new ZipfWrapper(conf.skewness, conf.init_keys);
+    // the new keys of inserts
+    std::string key_buf;
+
+    Benchmark(Config &conf, bool synthetic = true) : init_key(0), _conf(conf) {
+        workload = NULL;
+        dataset = NULL;
+        if (synthetic) {
+            dataset =
+                DataSet::open(conf.init_keys, conf.val_length, conf.key_shape);
+            if (conf.workload == RANDOM) {
+                workload = new RandomGenerator();
+            } else if (conf.workload == ZIPFIAN) {
+                workload = new ZipfWrapper(conf.skewness, conf.init_keys);
+            }
         }
 
         x = NULL;
@@ -64,20 +63,53 @@ class Benchmark {
         return std::make_pair(INSERT, workload->Next());
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    // the key is valid until the next call
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next();
-        return std::make_pair(INSERT, dataset->wl_str[next % _conf.init_keys]);
+        return std::make_pair(INSERT, dataset->get(next % _conf.init_keys));
     }
 
-    virtual long long nextInitIntKey() {
+    // build the initial integer keys, initIntKey is thread safe after it
+    virtual void prepareLoad() {
         if (x == NULL)
             x = random_shuffle(_conf.init_keys);
-        return x[init_key++ % _conf.init_keys];
-        // return init_key++ % _conf.init_keys;
     }
 
-    virtual std::string nextInitStrKey() {
-        return dataset->wl_str[(init_key++) % _conf.init_keys];
+    // the i-th initial key
+    virtual long long initIntKey(unsigned long long i) {
+        return x[i % _conf.init_keys];
+        // return i % _conf.init_keys;
+    }
+
+    virtual KeyView initStrKey(unsigned long long i) {
+        return dataset->get(i % _conf.init_keys);
+    }
+
+    long long nextInitIntKey() {
+        prepareLoad();
+        return initIntKey(init_key++);
+    }
+
+    KeyView nextInitStrKey() { return initStrKey(init_key++); }
+
+    // value length of the last operation, 0 for the configured one
+    virtual int lastValueSize() { return 0; }
+
+    // a new key of c and d before an existing key, in key_buf
+    KeyView prefixKey(char c, char d, KeyView key) {
+        key_buf.resize(key.len + 2);
+        key_buf[0] = c;
+        key_buf[1] = d;
+        memcpy(&key_buf[2], key.data, key.len);
+        return KeyView(key_buf.c_str(), key.len + 2);
+    }
+
+    // string key of the next operation without a copy, value_len is 0 if
+    // the benchmark does not care
+    virtual OperationType nextRawOperation(const char *&key, int &key_len,
+                                           int &value_len) {
+        assert(0);
+        return GET;
     }
 } __attribute__((aligned(64)));
 
@@ -90,9 +122,9 @@ class ReadOnlyBench : public Benchmark {
         return std::make_pair(GET, d);
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
+    std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next() % _conf.init_keys;
-        return std::make_pair(GET, dataset->wl_str[next]);
+        return std::make_pair(GET, dataset->get(next));
     }
 } __attribute__((aligned(64)));
 
@@ -113,19 +145,18 @@ class InsertOnlyBench : public Benchmark {
         return std::make_pair(INSERT, d * x);
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
+    std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
         char c = rdm.randomInt() % 94 + 33;
         char d = rdm.randomInt() % 94 + 33;
-        s = d + s;
-        s = c + s;
-        return std::make_pair(INSERT, s);
+        return std::make_pair(INSERT, prefixKey(c, d, dataset->get(next)));
     }
 
 #ifndef INSERT_DUP
 
-    long long nextInitIntKey() { return 128 * Benchmark::nextInitIntKey(); }
+    long long initIntKey(unsigned long long i) {
+        return 128 * Benchmark::initIntKey(i);
+    }
 
 #endif
 } __attribute__((aligned(64)));
@@ -141,9 +172,9 @@ class UpdateOnlyBench : public Benchmark {
         return std::make_pair(UPDATE, d);
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
+    std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next() % _conf.init_keys;
-        return std::make_pair(UPDATE, dataset->wl_str[next]);
+        return std::make_pair(UPDATE, dataset->get(next));
     }
 } __attribute__((aligned(64)));
 
@@ -156,16 +187,16 @@ class DeleteOnlyBench : public Benchmark {
         return std::make_pair(REMOVE, d);
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
+    std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next() % _conf.init_keys;
-        return std::make_pair(REMOVE, dataset->wl_str[next]);
+        return std::make_pair(REMOVE, dataset->get(next));
     }
 } __attribute__((aligned(64)));
 
 class MixedBench : public Benchmark {
     int round;
     long long key;
-    std::string skey;
+    KeyView skey;
 
   public:
     MixedBench(Config &conf) : Benchmark(conf) {}
@@ -195,14 +226,14 @@ class MixedBench : public Benchmark {
         return result;
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
-        std::pair<OperationType, std::string> result;
+    std::pair<OperationType, KeyView> nextStrOperation() {
+        std::pair<OperationType, KeyView> result;
         long long next = workload->Next() % _conf.init_keys;
-        std::string _key = dataset->wl_str[next];
+        KeyView _key = dataset->get(next);
         switch (round) {
         case 0:
             next = workload->Next() % _conf.init_keys;
-            skey = dataset->wl_str[next];
+            skey = dataset->get(next);
             result = std::make_pair(REMOVE, skey);
             break;
         case 1:
@@ -232,9 +263,9 @@ class ScanBench : public Benchmark {
         return std::make_pair(SCAN, d);
     }
 
-    std::pair<OperationType, std::string> nextStrOperation() {
+    std::pair<OperationType, KeyView> nextStrOperation() {
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         return std::make_pair(SCAN, s);
     }
 } __attribute__((aligned(64)));
@@ -260,16 +291,14 @@ class YSCBA : public Benchmark {
         }
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         int k = rdm.randomInt() % 100;
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         if (k > read_ratio) {
             char c = rdm.randomInt() % 94 + 33;
             char d = rdm.randomInt() % 94 + 33;
-            s = d + s;
-            s = c + s;
-            return std::make_pair(INSERT, s);
+            return std::make_pair(INSERT, prefixKey(c, d, s));
         } else {
             return std::make_pair(GET, s);
         }
@@ -296,16 +325,14 @@ class YSCBB : public Benchmark {
         }
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         int k = rdm.randomInt() % 100;
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         if (k > read_ratio) {
             char c = rdm.randomInt() % 94 + 33;
             char d = rdm.randomInt() % 94 + 33;
-            s = d + s;
-            s = c + s;
-            return std::make_pair(INSERT, s);
+            return std::make_pair(INSERT, prefixKey(c, d, s));
         } else {
             return std::make_pair(GET, s);
         }
@@ -332,10 +359,10 @@ class YSCBC : public Benchmark {
         }
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         int k = rdm.randomInt() % 100;
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         if (k > read_ratio) {
             return std::make_pair(UPDATE, s);
         } else {
@@ -364,16 +391,14 @@ class YSCBD : public Benchmark {
         }
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         int k = rdm.randomInt() % 100;
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         if (k > read_ratio) {
             char c = rdm.randomInt() % 94 + 33;
             char d = rdm.randomInt() % 94 + 33;
-            s = d + s;
-            s = c + s;
-            return std::make_pair(INSERT, s);
+            return std::make_pair(INSERT, prefixKey(c, d, s));
         } else {
             return std::make_pair(GET, s);
         }
@@ -399,20 +424,166 @@ class YSCBE : public Benchmark {
         }
     }
 
-    virtual std::pair<OperationType, std::string> nextStrOperation() {
+    virtual std::pair<OperationType, KeyView> nextStrOperation() {
         int k = rdm.randomInt() % 100;
         long long next = workload->Next() % _conf.init_keys;
-        std::string s = dataset->wl_str[next];
+        KeyView s = dataset->get(next);
         if (k < scan_ratio) {
             return std::make_pair(SCAN, s);
         } else {
             char c = rdm.randomInt() % 94 + 33;
             char d = rdm.randomInt() % 94 + 33;
-            s = d + s;
-            s = c + s;
-            return std::make_pair(INSERT, s);
+            return std::make_pair(INSERT, prefixKey(c, d, s));
+        }
+    }
+} __attribute__((aligned(64)));
+
+// replay a binary trace, every worker replays its own partition of the run
+// phase and starts over at the end of it
+class TraceBench : public Benchmark {
+    TraceFile *trace;
+    uint64_t begin, end, cursor;
+
+    inline const TraceRecord &next() {
+        if (cursor == end) {
+            if (end == 0)
+                claim();
+            cursor = begin;
+        }
+        return trace->record(cursor++);
+    }
+
+    // the partition is claimed by the worker at its first operation, the
+    // loader does not take one
+    void claim() {
+        int parts = _conf.num_threads;
+        int part = trace->claim_partition() % parts;
+        uint64_t n = trace->run_count();
+        begin = trace->load_count() + n * part / parts;
+        end = trace->load_count() + n * (part + 1) / parts;
+        if (begin == end) {
+            printf("[TRACE]\tno records for partition %d\n", part);
+            exit(1);
         }
+        cursor = begin;
+    }
+
+  public:
+    TraceBench(Config &conf)
+        : Benchmark(conf, false), begin(0), end(0), cursor(0) {
+        trace = TraceFile::open(conf.filename);
+    }
+
+    std::pair<OperationType, long long> nextIntOperation() {
+        const TraceRecord &r = next();
+        long long d;
+        memcpy(&d, trace->key(r), sizeof(d));
+        return std::make_pair((OperationType)r.op, d);
+    }
+
+    std::pair<OperationType, KeyView> nextStrOperation() {
+        const TraceRecord &r = next();
+        return std::make_pair((OperationType)r.op,
+                              KeyView(trace->key(r), r.key_len));
+    }
+
+    int lastValueSize() { return trace->record(cursor - 1).value_size; }
+
+    void prepareLoad() {}
+
+    long long initIntKey(unsigned long long i) {
+        const TraceRecord &r = trace->record(i % trace->load_count());
+        long long d;
+        memcpy(&d, trace->key(r), sizeof(d));
+        return d;
+    }
+
+    KeyView initStrKey(unsigned long long i) {
+        const TraceRecord &r = trace->record(i % trace->load_count());
+        return KeyView(trace->key(r), r.key_len);
     }
 } __attribute__((aligned(64)));
 
+struct Operation {
+    OperationType op;
+    int value_len; // 0 for the configured value length
+    long long ikey;
+    KeyView skey;
+};
+
+/*
+ * Operations of a worker generated before the timing starts, so that the
+ * benchmark measures the index instead of the key generation. Keys of the
+ * data set and the trace are referred in place, only the newly generated
+ * keys are copied into the arena of the stream.
+ *
+ * A stream of gets, updates and scans is replayed from the beginning when it
+ * runs out. A stream with inserts or removes is not: a replayed insert only
+ * finds its key again and a replayed remove finds nothing, so after the
+ * first pass the operations are generated on the fly, with fresh keys from
+ * the benchmark, and the worker warns that -O is too small for the run.
+ */
+class OpStream {
+    Benchmark *benchmark;
+    KeyType key_type;
+    std::vector<Operation> ops;
+    std::vector<char> arena;
+    size_t cursor;
+    bool replay;   // no operation of the stream changes the key set
+    bool warned;
+    Operation cur; // without a stream, or after it ran out
+
+    inline void generate(Operation &o) {
+        if (key_type == Integer) {
+            auto next_operation = benchmark->nextIntOperation();
+            o.op = next_operation.first;
+            o.ikey = next_operation.second;
+        } else {
+            auto next_operation = benchmark->nextStrOperation();
+            o.op = next_operation.first;
+            o.skey = next_operation.second;
+        }
+        o.value_len = benchmark->lastValueSize();
+    }
+
+  public:
+    // len is 0 to generate every operation when it is needed
+    OpStream(Benchmark *b, KeyType key_type, size_t len)
+        : benchmark(b), key_type(key_type), ops(len), cursor(0), replay(true),
+          warned(false) {
+        // (operation, arena offset) of the copied keys
+        std::vector<std::pair<size_t, size_t>> copied;
+        for (size_t i = 0; i < len; i++) {
+            Operation &o = ops[i];
+            generate(o);
+            if (o.op == INSERT || o.op == REMOVE)
+                replay = false;
+            if (key_type == String && o.skey.data == b->key_buf.c_str()) {
+                copied.push_back(std::make_pair(i, arena.size()));
+                arena.insert(arena.end(), o.skey.data,
+                             o.skey.data + o.skey.len + 1);
+            }
+        }
+        for (auto &c : copied)
+            ops[c.first].skey.data = arena.data() + c.second;
+    }
+
+    inline const Operation &next() {
+        if (cursor < ops.size())
+            return ops[cursor++];
+        if (replay && !ops.empty()) {
+            cursor = 1;
+            return ops[0];
+        }
+        if (!ops.empty() && !warned) {
+            warned = true;
+            printf("[OP STREAM]\t%lu operations with inserts or removes ran "
+                   "out, generating on the fly, raise -O\n",
+                   ops.size());
+        }
+        generate(cur);
+        return cur;
+    }
+};
+
 #endif
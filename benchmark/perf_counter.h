@@ -0,0 +1,172 @@
+#pragma once
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_STALLS, // backend stall cycles, mostly waiting for memory
+    _PerfEventNumber
+};
+
+static inline const char *perf_event_name(int e) {
+    static const char *names[_PerfEventNumber] = {
+        "cycles", "instructions", "llc_misses", "dtlb_misses", "stall_cycles"};
+    return names[e];
+}
+
+// counter values of one or more threads, an event not supported by the cpu
+// or the kernel is not valid
+struct PerfValues {
+    uint64_t value[_PerfEventNumber];
+    bool valid[_PerfEventNumber];
+
+    PerfValues() {
+        memset(value, 0, sizeof(value));
+        memset(valid, 0, sizeof(valid));
+    }
+
+    void operator+=(const PerfValues &p) {
+        for (int e = 0; e < _PerfEventNumber; e++) {
+            value[e] += p.value[e];
+            valid[e] = valid[e] || p.valid[e];
+        }
+    }
+
+    bool any() const {
+        for (int e = 0; e < _PerfEventNumber; e++)
+            if (valid[e])
+                return true;
+        return false;
+    }
+};
+
+/*
+ * Hardware counters of the calling thread in one perf_event_open group
+ *
+ * The cycles counter leads the group so that all events are scheduled on
+ * the pmu together, the values are scaled if the kernel multiplexed the
+ * group. Only user space is counted, which works with perf_event_paranoid
+ * up to 2. If the leader can not be opened (no pmu in a vm or container,
+ * seccomp, paranoid 3) the group is empty and every value is invalid, an
+ * event the cpu does not have is left out of the group.
+ */
+class PerfGroup {
+  public:
+    PerfGroup() : leader(-1), members(0) {
+        for (int e = 0; e < _PerfEventNumber; e++)
+            fd[e] = -1;
+        for (int e = 0; e < _PerfEventNumber; e++) {
+            fd[e] = open_event(e, leader);
+            if (fd[e] < 0) {
+                warn_once(e);
+                if (e == PERF_CYCLES)
+                    return;
+                continue;
+            }
+            if (e == PERF_CYCLES)
+                leader = fd[e];
+            order[members++] = e;
+        }
+    }
+
+    ~PerfGroup() {
+        for (int e = 0; e < _PerfEventNumber; e++)
+            if (fd[e] >= 0)
+                close(fd[e]);
+    }
+
+    bool available() const { return leader >= 0; }
+
+    void start() {
+        if (leader < 0)
+            return;
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // the counts since start
+    PerfValues stop() {
+        PerfValues v;
+        if (leader < 0)
+            return v;
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, time enabled, time running, a value of every member
+        uint64_t buf[3 + _PerfEventNumber];
+        ssize_t n = read(leader, buf, sizeof(buf));
+        if (n < (ssize_t)(3 * sizeof(uint64_t)) || buf[0] != (uint64_t)members)
+            return v;
+        double scale = 1.0;
+        if (buf[2] != 0 && buf[2] < buf[1])
+            scale = (double)buf[1] / buf[2];
+        for (int i = 0; i < members; i++) {
+            v.value[order[i]] = (uint64_t)(buf[3 + i] * scale);
+            v.valid[order[i]] = true;
+        }
+        return v;
+    }
+
+  private:
+    static int open_event(int e, int group_fd) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (e) {
+        case PERF_CYCLES:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_STALLS:
+            attr.config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+            break;
+        }
+        attr.disabled = (group_fd < 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+    }
+
+    // every thread opens its own group, the reason is printed once
+    static void warn_once(int e) {
+        static std::mutex mtx;
+        static bool warned[_PerfEventNumber] = {false};
+        int err = errno;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (warned[e])
+            return;
+        warned[e] = true;
+        printf("[PERF]\t%s counter unavailable: %s\n", perf_event_name(e),
+               strerror(err));
+    }
+
+    int fd[_PerfEventNumber];
+    int order[_PerfEventNumber]; // event of every member in the group
+    int leader;
+    int members;
+};
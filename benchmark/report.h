@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Machine readable results, one row per benchmark run
+ *
+ * A file ending with .json or .jsonl gets a json object per line, any other
+ * file gets csv with the columns of the first row as the header.
+ */
+class ResultWriter {
+  public:
+    struct Field {
+        std::string name;
+        std::string value;
+        bool number;
+    };
+
+    static Field num(const char *name, double v) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.6g", v);
+        return Field{name, buf, true};
+    }
+
+    static Field str(const char *name, const std::string &v) {
+        return Field{name, v, false};
+    }
+
+    ResultWriter(const std::string &filename) : out(nullptr), rows(0) {
+        if (filename.empty())
+            return;
+        out = fopen(filename.c_str(), "w");
+        if (out == nullptr) {
+            printf("[REPORT]\tfailed to open %s\n", filename.c_str());
+            return;
+        }
+        json = ends_with(filename, ".json") || ends_with(filename, ".jsonl");
+    }
+
+    ~ResultWriter() {
+        if (out != nullptr)
+            fclose(out);
+    }
+
+    void row(const std::vector<Field> &fields) {
+        if (out == nullptr)
+            return;
+        if (json) {
+            fputc('{', out);
+            for (size_t i = 0; i < fields.size(); i++) {
+                fprintf(out, "%s\"%s\": ", i ? ", " : "",
+                        fields[i].name.c_str());
+                if (fields[i].number)
+                    fputs(fields[i].value.c_str(), out);
+                else
+                    fprintf(out, "\"%s\"", fields[i].value.c_str());
+            }
+            fputs("}\n", out);
+        } else {
+            if (rows == 0) {
+                for (size_t i = 0; i < fields.size(); i++)
+                    fprintf(out, "%s%s", i ? "," : "", fields[i].name.c_str());
+                fputc('\n', out);
+            }
+            for (size_t i = 0; i < fields.size(); i++)
+                fprintf(out, "%s%s", i ? "," : "", fields[i].value.c_str());
+            fputc('\n', out);
+        }
+        fflush(out);
+        rows++;
+    }
+
+  private:
+    static bool ends_with(const std::string &s, const std::string &suffix) {
+        return s.size() >= suffix.size() &&
+               s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    FILE *out;
+    bool json;
+    int rows;
+};
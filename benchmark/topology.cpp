@@ -0,0 +1,206 @@
+#include "topology.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+#include <unistd.h>
+
+const char *pin_policy_name(int policy) {
+    static const char *names[_PinPolicyNumber] = {
+        "none", "compact", "scatter", "one-socket-first", "no-SMT"};
+    if (policy < 0 || policy >= _PinPolicyNumber)
+        return "unknown";
+    return names[policy];
+}
+
+static const std::string cpu_dir = "/sys/devices/system/cpu/";
+static const std::string node_dir = "/sys/devices/system/node/";
+
+static bool read_line(const std::string &file, std::string &line) {
+    std::ifstream in(file);
+    return (bool)std::getline(in, line);
+}
+
+static int read_int(const std::string &file, int fallback) {
+    std::string line;
+    if (!read_line(file, line) || line.empty())
+        return fallback;
+    return atoi(line.c_str());
+}
+
+// a cpu list of sysfs, e.g. "0-3,8,10-11"
+static std::vector<int> parse_cpu_list(const std::string &s) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string range = s.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty()) {
+            int lo = atoi(range.c_str());
+            int hi = dash == std::string::npos
+                         ? lo
+                         : atoi(range.c_str() + dash + 1);
+            for (int c = lo; c <= hi; c++)
+                cpus.push_back(c);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+CpuTopology::CpuTopology() {
+    std::string line;
+    std::vector<int> online;
+    if (read_line(cpu_dir + "online", line))
+        online = parse_cpu_list(line);
+    if (online.empty()) {
+        for (int c = 0; c < sysconf(_SC_NPROCESSORS_ONLN); c++)
+            online.push_back(c);
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool has_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::map<int, int> node_of;
+    DIR *dir = opendir(node_dir.c_str());
+    if (dir != nullptr) {
+        struct dirent *e;
+        while ((e = readdir(dir)) != nullptr) {
+            if (strncmp(e->d_name, "node", 4) != 0 || e->d_name[4] < '0' ||
+                e->d_name[4] > '9')
+                continue;
+            int node = atoi(e->d_name + 4);
+            if (read_line(node_dir + e->d_name + "/cpulist", line)) {
+                for (int c : parse_cpu_list(line))
+                    node_of[c] = node;
+            }
+        }
+        closedir(dir);
+    }
+
+    // core ids are sparse and only unique within a socket, they are turned
+    // into ranks below
+    std::vector<int> core_id;
+    for (int c : online) {
+        if (has_mask && !CPU_ISSET(c, &allowed))
+            continue;
+        std::string topo = cpu_dir + "cpu" + std::to_string(c) + "/topology/";
+        CpuInfo info;
+        info.id = c;
+        info.socket = std::max(0, read_int(topo + "physical_package_id", 0));
+        info.node = node_of.count(c) ? node_of[c] : 0;
+        info.core = 0;
+        info.smt = 0;
+        cpu_list.push_back(info);
+        core_id.push_back(read_int(topo + "core_id", c));
+    }
+    if (cpu_list.empty()) {
+        CpuInfo info = {0, 0, 0, 0, 0};
+        cpu_list.push_back(info);
+        core_id.push_back(0);
+    }
+
+    std::map<std::pair<int, int>, int> core_rank; // (socket, core id)
+    for (size_t i = 0; i < cpu_list.size(); i++)
+        core_rank[std::make_pair(cpu_list[i].socket, core_id[i])] = 0;
+    std::map<int, int> cores_of_socket;
+    for (auto &c : core_rank)
+        c.second = cores_of_socket[c.first.first]++;
+
+    std::map<std::pair<int, int>, int> siblings; // (socket, core rank)
+    for (size_t i = 0; i < cpu_list.size(); i++) {
+        CpuInfo &info = cpu_list[i];
+        info.core = core_rank[std::make_pair(info.socket, core_id[i])];
+        info.smt = siblings[std::make_pair(info.socket, info.core)]++;
+    }
+}
+
+const CpuTopology &CpuTopology::get() {
+    static CpuTopology topology;
+    return topology;
+}
+
+const CpuInfo *CpuTopology::find(int id) const {
+    for (const CpuInfo &c : cpu_list)
+        if (c.id == id)
+            return &c;
+    return nullptr;
+}
+
+std::vector<int> CpuTopology::order(PinPolicy policy) const {
+    std::vector<CpuInfo> cpus = cpu_list;
+    typedef std::tuple<int, int, int, int> SortKey;
+    auto sort_by = [&](SortKey (*key)(const CpuInfo &)) {
+        std::sort(cpus.begin(), cpus.end(),
+                  [key](const CpuInfo &a, const CpuInfo &b) {
+                      return key(a) < key(b);
+                  });
+    };
+
+    switch (policy) {
+    case PIN_COMPACT:
+        sort_by([](const CpuInfo &c) {
+            return SortKey(c.socket, c.core, c.smt, c.id);
+        });
+        break;
+    case PIN_SCATTER:
+        sort_by([](const CpuInfo &c) {
+            return SortKey(c.smt, c.core, c.socket, c.id);
+        });
+        break;
+    case PIN_NO_SMT:
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                  [](const CpuInfo &c) { return c.smt != 0; }),
+                   cpus.end());
+    // fall through
+    case PIN_SOCKET_FIRST:
+        sort_by([](const CpuInfo &c) {
+            return SortKey(c.smt, c.socket, c.core, c.id);
+        });
+        break;
+    default:
+        break;
+    }
+
+    std::vector<int> ids;
+    for (const CpuInfo &c : cpus)
+        ids.push_back(c.id);
+    return ids;
+}
+
+std::string CpuTopology::describe(PinPolicy policy, int threads) const {
+    if (policy == PIN_NONE)
+        return "unpinned";
+    std::vector<int> ids = order(policy);
+    std::string s;
+    char buf[64];
+    for (int t = 0; t < threads; t++) {
+        const CpuInfo *c = find(ids[t % ids.size()]);
+        snprintf(buf, sizeof(buf), "%s%d(%d/%d/%d)", t ? " " : "", c->id,
+                 c->socket, c->core, c->smt);
+        s += buf;
+    }
+    return s;
+}
+
+int pin_thread(int id, PinPolicy policy) {
+    if (policy == PIN_NONE || id < 0)
+        return 0;
+    std::vector<int> ids = CpuTopology::get().order(policy);
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(ids[id % ids.size()], &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+}
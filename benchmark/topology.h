@@ -0,0 +1,57 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+enum PinPolicy {
+    PIN_NONE,         // leave the threads to the scheduler
+    PIN_COMPACT,      // fill the SMT siblings of a core, then the next core
+    PIN_SCATTER,      // round robin over sockets, one thread per core first
+    PIN_SOCKET_FIRST, // every core of a socket, then the next socket, then SMT
+    PIN_NO_SMT,       // one thread per core, socket after socket
+    _PinPolicyNumber
+};
+
+const char *pin_policy_name(int policy);
+
+struct CpuInfo {
+    int id;
+    int socket; // physical package
+    int node;   // numa node
+    int core;   // rank of the core in its socket
+    int smt;    // rank of the cpu among the siblings of its core
+};
+
+/*
+ * CPUs of the machine read from sysfs
+ *
+ * Only the cpus in the affinity mask of the process are used, so a run
+ * under taskset or in a container pins inside its cpuset. Without sysfs
+ * every cpu is taken as a core of its own in socket 0.
+ */
+class CpuTopology {
+  public:
+    static const CpuTopology &get();
+
+    const std::vector<CpuInfo> &cpus() const { return cpu_list; }
+
+    // cpu of every thread id under the policy, thread ids beyond the
+    // number of cpus wrap around
+    std::vector<int> order(PinPolicy policy) const;
+
+    // "cpu(socket/core/smt)" of the first threads
+    std::string describe(PinPolicy policy, int threads) const;
+
+  private:
+    CpuTopology();
+
+    const CpuInfo *find(int id) const;
+
+    std::vector<CpuInfo> cpu_list;
+};
+
+// pin the calling thread to the cpu of thread id, 0 or an errno
+int pin_thread(int id, PinPolicy policy);
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,128 @@
+#include "trace.h"
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char TraceFile::magic[8] = {'A', 'R', 'T', 'T', 'R', 'A', 'C', 'E'};
+
+static std::mutex trace_mtx;
+static std::map<std::string, TraceFile *> trace_map;
+
+TraceFile *TraceFile::open(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    auto it = trace_map.find(filename);
+    if (it != trace_map.end())
+        return it->second;
+    TraceFile *trace = new TraceFile(filename);
+    trace_map[filename] = trace;
+    return trace;
+}
+
+TraceFile::TraceFile(const std::string &filename) : next_partition(0) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("[TRACE]\tfailed to open trace %s\n", filename.c_str());
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file_size = st.st_size;
+    if (file_size < sizeof(TraceHeader)) {
+        printf("[TRACE]\t%s is not a trace\n", filename.c_str());
+        exit(1);
+    }
+    void *addr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        printf("[TRACE]\tmmap %s failed\n", filename.c_str());
+        exit(1);
+    }
+
+    header = (const TraceHeader *)addr;
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        header->version != version) {
+        printf("[TRACE]\t%s is not a trace of version %u\n", filename.c_str(),
+               version);
+        exit(1);
+    }
+    // the sizes are checked without overflow, a truncated or corrupt trace
+    // must not make the workers read past the mapping
+    if (header->key_type >= _KeyTypeNumber ||
+        header->key_start < sizeof(TraceHeader) ||
+        header->key_start > file_size ||
+        header->key_bytes > file_size - header->key_start ||
+        header->record_count >
+            (header->key_start - sizeof(TraceHeader)) / sizeof(TraceRecord) ||
+        header->load_count > header->record_count) {
+        printf("[TRACE]\t%s has a corrupt header\n", filename.c_str());
+        exit(1);
+    }
+    records = (const TraceRecord *)(header + 1);
+    keys = (const char *)addr + header->key_start;
+    // the records are read in order by every worker
+    madvise(addr, file_size, MADV_SEQUENTIAL);
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        const TraceRecord &r = records[i];
+        // a key is followed by its '\0', integer keys are 8 bytes
+        bool ok = r.op < MIXED && r.key_offset < header->key_bytes &&
+                  r.key_len < header->key_bytes - r.key_offset &&
+                  keys[r.key_offset + r.key_len] == '\0' &&
+                  (header->key_type != Integer ||
+                   r.key_len == sizeof(long long));
+        if (!ok) {
+            printf("[TRACE]\t%s has a corrupt record %llu\n", filename.c_str(),
+                   (unsigned long long)i);
+            exit(1);
+        }
+    }
+    printf("[TRACE]\tmap %s, %llu load and %llu run records\n",
+           filename.c_str(), (unsigned long long)load_count(),
+           (unsigned long long)run_count());
+}
+
+void TraceWriter::add(bool load, uint8_t op, const char *key, int key_len,
+                      uint32_t value_size) {
+    TraceRecord r;
+    r.op = op;
+    r.reserved = 0;
+    r.key_len = key_len;
+    r.value_size = value_size;
+    r.key_offset = key_area.size();
+    key_area.append(key, key_len);
+    key_area.push_back('\0');
+    if (load)
+        load_records.push_back(r);
+    else
+        run_records.push_back(r);
+}
+
+bool TraceWriter::write(const std::string &filename) {
+    TraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TraceFile::magic, sizeof(h.magic));
+    h.version = TraceFile::version;
+    h.key_type = key_type;
+    h.load_count = load_records.size();
+    h.record_count = load_records.size() + run_records.size();
+    h.key_start = sizeof(TraceHeader) + h.record_count * sizeof(TraceRecord);
+    h.key_bytes = key_area.size();
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (!load_records.empty())
+        ok = ok && fwrite(load_records.data(), sizeof(TraceRecord),
+                          load_records.size(), f) == load_records.size();
+    if (!run_records.empty())
+        ok = ok && fwrite(run_records.data(), sizeof(TraceRecord),
+                          run_records.size(), f) == run_records.size();
+    ok = ok && fwrite(key_area.data(), 1, key_area.size(), f) ==
+                   key_area.size();
+    return fclose(f) == 0 && ok;
+}
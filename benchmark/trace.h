@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "config.h"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Binary trace of operations
+ *
+ * | header | records of the load phase | records of the run phase | keys |
+ *
+ * A record refers to its key by the offset in the key area, every key is
+ * followed by a '\0' so that the indexes with c string keys can use it in
+ * place. Integer keys are 8 bytes. The file is mmap-ed and shared by all
+ * workers, the run phase is split into one partition of each worker.
+ */
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_type;     // KeyType
+    uint64_t load_count;   // records of the load phase
+    uint64_t record_count; // records of both phases
+    uint64_t key_start;    // file offset of the key area
+    uint64_t key_bytes;
+};
+
+struct TraceRecord {
+    uint8_t op; // OperationType
+    uint8_t reserved;
+    uint16_t key_len; // without the '\0'
+    uint32_t value_size;
+    uint64_t key_offset; // in the key area
+};
+
+class TraceFile {
+  public:
+    static const char magic[8];
+    static const uint32_t version = 1;
+
+    // the mapping of a file is shared by all callers
+    static TraceFile *open(const std::string &filename);
+
+    uint64_t load_count() const { return header->load_count; }
+    uint64_t run_count() const {
+        return header->record_count - header->load_count;
+    }
+    KeyType key_type() const { return (KeyType)header->key_type; }
+
+    const TraceRecord &record(uint64_t i) const { return records[i]; }
+    const char *key(const TraceRecord &r) const { return keys + r.key_offset; }
+
+    // partitions of the run phase are handed out round robin
+    int claim_partition() { return next_partition++; }
+
+  private:
+    TraceFile(const std::string &filename);
+
+    const TraceHeader *header;
+    const TraceRecord *records;
+    const char *keys;
+    size_t file_size;
+    std::atomic<int> next_partition;
+};
+
+// build a trace file, load records are written before the run records
+class TraceWriter {
+  public:
+    TraceWriter(KeyType key_type) : key_type(key_type) {}
+
+    void add(bool load, uint8_t op, const char *key, int key_len,
+             uint32_t value_size);
+
+    bool write(const std::string &filename);
+
+  private:
+    KeyType key_type;
+    std::vector<TraceRecord> load_records;
+    std::vector<TraceRecord> run_records;
+    std::string key_area;
+};
+
+#endif // TRACE_H
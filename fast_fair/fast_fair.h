@@ -51,7 +51,10 @@ int node_cnt = 0;
 
 using namespace std;
 
-static inline void mfence() { asm volatile("mfence" ::: "memory"); }
+static inline void mfence() {
+    asm volatile("mfence" ::: "memory");
+    COUNT_PERSIST_EVENT(fence, 1);
+}
 
 static inline void clflush(char *data, int len) {
     volatile char *ptr = (char *)((unsigned long)data & ~(CACHE_LINE_SIZE - 1));
@@ -61,11 +64,15 @@ static inline void clflush(char *data, int len) {
                                                           CPU_FREQ_MHZ / 1000);
 #ifdef CLFLUSH
         asm volatile("clflush %0" : "+m"(*(volatile char *)ptr));
+        COUNT_PERSIST_EVENT(clflush, 1);
 #elif CLFLUSH_OPT
         asm volatile(".byte 0x66; clflush %0" : "+m"(*(volatile char *)(ptr)));
+        COUNT_PERSIST_EVENT(clwb, 1);
 #elif CLWB
         asm volatile(".byte 0x66; xsaveopt %0" : "+m"(*(volatile char *)(ptr)));
+        COUNT_PERSIST_EVENT(clwb, 1);
 #endif
+        COUNT_PERSIST_EVENT(flush_bytes, CACHE_LINE_SIZE);
         while (read_tsc() < etsc)
             cpu_pause();
     }
@@ -22,10 +22,20 @@ class GarbageNode {
     void *node_p;
     GarbageNode *next_p;
 
-    GarbageNode(uint64_t p_delete_epoch, void *p_node_p)
-        : delete_epoch{p_delete_epoch}, node_p{p_node_p}, next_p{nullptr} {}
+    // whether node_p is also recorded in the persistent garbage log
+    bool logged;
 
-    GarbageNode() : delete_epoch{0UL}, node_p{nullptr}, next_p{nullptr} {}
+    // whether node_p is the root of an unlinked subtree, which is freed
+    // with everything below it
+    bool subtree;
+
+    GarbageNode(uint64_t p_delete_epoch, void *p_node_p, bool p_subtree)
+        : delete_epoch{p_delete_epoch}, node_p{p_node_p}, next_p{nullptr},
+          logged{false}, subtree{p_subtree} {}
+
+    GarbageNode()
+        : delete_epoch{0UL}, node_p{nullptr}, next_p{nullptr}, logged{false},
+          subtree{false} {}
 } __attribute__((aligned(64)));
 
 class GCMetaData {
@@ -35,6 +45,8 @@ class GCMetaData {
     // So if we take a global minimum of this value, that minimum could be
     // be used as the global epoch value to decide whether a garbage node could
     // be recycled
+    // With QSBR it is the epoch of the last quiescent state of an online
+    // thread, the thread holds no reference to nodes retired before it
     uint64_t last_active_epoch;
 
     GarbageNode header;
@@ -51,10 +63,16 @@ class GCMetaData {
     // We use this as a threshold to trigger GC
     int node_count;
 
+    // Positions of the oldest and the next entry in the persistent garbage
+    // log, they are never persisted since the log is scanned after a crash
+    uint64_t log_head;
+    uint64_t log_tail;
+
     GCMetaData() {
         last_active_epoch = static_cast<uint64_t>(-1);
         last_p = &header;
         node_count = 0;
+        log_head = log_tail = 0;
     }
     ~GCMetaData() {}
 } __attribute__((aligned(64)));
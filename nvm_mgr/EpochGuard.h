@@ -5,8 +5,16 @@
 namespace NVMMgr_ns {
 class EpochGuard {
   public:
+#ifdef QSBR
+    // threads announce quiescent states between operations instead
+    EpochGuard() {}
+    ~EpochGuard() {}
+#else
     EpochGuard() { JoinNewEpoch(); }
     ~EpochGuard() { LeaveThisEpoch(); }
+#endif
     static void DeleteNode(void *node) { MarkNodeGarbage(node); }
+    // retire an unlinked subtree as one garbage entry
+    static void DeleteSubtree(void *node) { MarkSubtreeGarbage(node); }
 };
 } // namespace NVMMgr_ns
\ No newline at end of file
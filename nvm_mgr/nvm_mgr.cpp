@@ -75,7 +75,7 @@ NVMMgr::NVMMgr() {
         // persist it
         memset((void *)meta_data, 0, PGSIZE);
 
-        meta_data->status = magic_number;
+        meta_data->status = magic_number + node_layout;
         meta_data->threads = 0;
         meta_data->free_bit_offset = 0;
         meta_data->generation_version = 0;
@@ -83,11 +83,19 @@ NVMMgr::NVMMgr() {
         flush_data((void *)meta_data, PGSIZE);
         printf("[NVM MGR]\tinitialize nvm file's head\n");
     } else {
+        if (meta_data->status != magic_number + node_layout) {
+            printf("[NVM MGR]\tfile has node layout %d, this build uses %d, "
+                   "migrate it with art_migrate dump of a build of its "
+                   "layout and art_migrate load of this build\n",
+                   meta_data->status - magic_number, node_layout);
+            exit(1);
+        }
         meta_data->generation_version++;
         flush_data((void *)&meta_data->generation_version, sizeof(uint64_t));
         printf("nvm mgr restart, the free offset is %lld, generation version "
                "is %lld\n",
                meta_data->free_bit_offset, meta_data->generation_version);
+        recover_done();
     }
 }
 
@@ -100,11 +108,22 @@ NVMMgr::~NVMMgr() {
     close(fd);
 }
 
-//    void NVMMgr::recover_done() {
-//        Head *head = (Head *) start_addr;
-//        head->threads = 0;
-//        flush_data((void *) head, sizeof(Head));
-//    }
+void NVMMgr::recover_done() {
+#ifdef LOG_GARBAGE
+    int threads = std::min(meta_data->threads, max_threads);
+    for (int i = 0; i < threads; i++) {
+        thread_info *old_ti = (thread_info *)get_thread_info(i);
+        old_ti->get_garbage_log()->collect(recovered_garbage,
+                                           recovered_subtrees);
+    }
+    printf("[NVM MGR]\tfind %lu retired nodes and %lu subtrees in %d garbage "
+           "logs\n",
+           recovered_garbage.size(), recovered_subtrees.size(), threads);
+#endif
+    // thread local areas can be allocated again
+    meta_data->threads = 0;
+    flush_data((void *)&(meta_data->threads), sizeof(int));
+}
 
 // bool NVMMgr::reload_free_blocks() {
 //    assert(free_page_list.empty());
@@ -163,6 +182,7 @@ void *NVMMgr::alloc_block(int tid) {
     flush_data((void *)&(meta_data->free_bit_offset), sizeof(uint64_t));
 
     void *addr = (void *)(data_block_start + id * PGSIZE);
+    COUNT_PERSIST_EVENT(pm_block, 1);
 
     //    printf("[NVM MGR]\talloc a new block %d, type is %d\n", id, type);
     //    std::cout<<"alloc a new block "<< meta_data->free_bit_offset<<"\n";
@@ -174,7 +194,8 @@ void *NVMMgr::alloc_block(int tid) {
 
 // mutiple threads to recovery free list for
 // threads using recovery_set
-void NVMMgr::recovery_free_memory(PART_ns::Tree *art, int forward_thread) {
+void NVMMgr::recovery_free_memory(PART_ns::Tree *art, int forward_thread,
+                                  int thread_num) {
     int owner = 0;
     for (int i = 0; i < meta_data->free_bit_offset; i++) {
         meta_data->bitmap[i] = (owner++) % forward_thread;
@@ -184,8 +205,7 @@ void NVMMgr::recovery_free_memory(PART_ns::Tree *art, int forward_thread) {
 
     const size_t power_two[10] = {8,   16,  32,   64,   128,
                                   256, 512, 1024, 2048, 4096};
-    const int thread_num = 36;
-    std::thread *tid[thread_num];
+    std::vector<std::thread *> tid(thread_num);
     int per_thread_block = meta_data->free_bit_offset / thread_num;
     if (meta_data->free_bit_offset % thread_num != 0)
         per_thread_block++;
@@ -11,6 +11,7 @@
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <vector>
 
 namespace NVMMgr_ns {
 
@@ -34,10 +35,11 @@ class NVMMgr {
      * local area before it is splitted. The recovery procedure can use the
      * thread local log to guarantee the crash consistency of the leaf.
      *
-     *       The function "recover_done" should be invoked after the recovery,
-     * otherwise these thread local persistent memories are leaked. The maximum
-     * number of thread local blocks can be allocated is hard coded in this
-     * file.
+     *       The function "recover_done" is invoked when the file is reopened,
+     * it collects the garbage logs of the last run and gives the thread local
+     * areas back, otherwise these thread local persistent memories are leaked.
+     * The maximum number of thread local blocks can be allocated is hard coded
+     * in this file.
      *
      *  data:
      *       True persistent memory allocated for applications. For simplicity,
@@ -46,6 +48,14 @@ class NVMMgr {
      */
   public:
     static const int magic_number = 12345;
+    // the layout of the persistent nodes, a file is only reopened by a build
+    // with the same layout. Files of the vtable layout keep magic_number,
+    // layout 1 had compact leaves with a garbage log of 32 bit slots
+#ifdef COMPACT_LEAF
+    static const int node_layout = 2;
+#else
+    static const int node_layout = 0;
+#endif
     static const int max_threads = 64;
 
     static const int PGSIZE = 256 * 1024;                     // 256K
@@ -66,7 +76,7 @@ class NVMMgr {
         char root[4096]; // for root
         uint64_t generation_version;
         uint64_t free_bit_offset;
-        int status;        // if equal to magic_number, it is reopen
+        int status;        // magic_number + node_layout once initialized
         int threads;       // threads number
         uint8_t bitmap[0]; // show every page type
         // 0: free, 1: N4, 2: N16, 3: N48, 4: N256, 5: Leaf
@@ -85,9 +95,12 @@ class NVMMgr {
 
     void *get_thread_info(int tid);
 
+    void recover_done();
+
     void *alloc_block(int tid);
 
-    void recovery_free_memory(PART_ns::Tree *art, int forward_thread);
+    void recovery_free_memory(PART_ns::Tree *art, int forward_thread,
+                              int thread_num = 36);
 
     uint64_t get_generation_version() { return meta_data->generation_version; }
 
@@ -95,6 +108,13 @@ class NVMMgr {
     int fd;
     bool first_created;
 
+#ifdef LOG_GARBAGE
+    // nodes retired but not freed before restart, reclaimed by the first
+    // registered thread
+    std::vector<uint64_t> recovered_garbage;
+    std::vector<uint64_t> recovered_subtrees;
+#endif
+
     // persist it as the head of nvm region
     Head *meta_data;
 } __attribute__((aligned(64)));
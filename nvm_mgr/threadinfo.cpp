@@ -7,6 +7,10 @@
 #include <list>
 #include <mutex>
 
+#ifdef COUNT_PERSIST
+__thread PersistCounter persist_counter;
+#endif
+
 namespace NVMMgr_ns {
 
 // global block allocator
@@ -18,6 +22,10 @@ std::mutex ti_lock;
 // global threadinfo list hread
 thread_info *ti_list_head = nullptr;
 
+// thread infos of exited threads, reused by new threads since the thread
+// local areas are limited
+std::vector<thread_info *> free_ti_list;
+
 // thread local info
 __thread thread_info *ti = nullptr;
 
@@ -32,7 +40,6 @@ __thread cpuCycleTimer *dcmm_time = nullptr;
 double getdcmmalloctime() { return dcmm_time->duration(); }
 #endif
 
-#ifdef INSTANT_RESTART
 uint64_t thread_result[40][8];
 void init() { memset(thread_result, 0, sizeof(thread_result)); }
 void increase(int id) { thread_result[id][0]++; }
@@ -44,6 +51,7 @@ uint64_t total(int thread_num) {
     return ans;
 }
 
+#ifdef INSTANT_RESTART
 __thread uint64_t thread_generation = 0;
 uint64_t get_threadlocal_generation() { return thread_generation; }
 #endif
@@ -175,6 +183,64 @@ size_t buddy_allocator::get_power_two_size(size_t s) {
     return power_two[id];
 }
 
+/*************************GarbageLog interface**************************/
+
+#ifdef LOG_GARBAGE
+void GarbageLog::reset() {
+    memset((void *)slots, 0, sizeof(slots));
+    flush_data((void *)slots, sizeof(slots));
+}
+
+bool GarbageLog::append(uint64_t pos, void *node, bool subtree) {
+    uint64_t addr = (uint64_t)node;
+    // only the nodes allocated from nvm_mgr can be logged
+    if (addr < NVMMgr::data_block_start ||
+        addr >= NVMMgr::start_addr + NVMMgr::filesize ||
+        addr % garbage_log_unit != 0 ||
+        (addr - NVMMgr::start_addr) / garbage_log_unit >=
+            garbage_subtree_bit) {
+        return false;
+    }
+    garbage_slot_t *slot = &slots[pos % garbage_log_length];
+    assert(*slot == 0);
+    *slot = (garbage_slot_t)((addr - NVMMgr::start_addr) / garbage_log_unit);
+    if (subtree)
+        *slot |= garbage_subtree_bit;
+    flush_data((void *)slot, sizeof(garbage_slot_t));
+    return true;
+}
+
+void GarbageLog::release(uint64_t pos, int cnt) {
+    if (cnt == 0)
+        return;
+    assert(cnt <= garbage_log_length);
+    int start = pos % garbage_log_length;
+    int first = std::min(cnt, garbage_log_length - start);
+    memset((void *)&slots[start], 0, first * sizeof(garbage_slot_t));
+    flush_data((void *)&slots[start], first * sizeof(garbage_slot_t));
+    if (first < cnt) {
+        // wrap around
+        memset((void *)slots, 0, (cnt - first) * sizeof(garbage_slot_t));
+        flush_data((void *)slots, (cnt - first) * sizeof(garbage_slot_t));
+    }
+}
+
+void GarbageLog::collect(std::vector<uint64_t> &nodes,
+                         std::vector<uint64_t> &subtrees) const {
+    for (int i = 0; i < garbage_log_length; i++) {
+        if (slots[i] != 0) {
+            uint64_t addr =
+                NVMMgr::start_addr +
+                (uint64_t)(slots[i] & ~garbage_subtree_bit) * garbage_log_unit;
+            if (slots[i] & garbage_subtree_bit)
+                subtrees.push_back(addr);
+            else
+                nodes.push_back(addr);
+        }
+    }
+}
+#endif
+
 /*************************thread_info interface**************************/
 
 thread_info::thread_info() {
@@ -189,6 +255,9 @@ thread_info::thread_info() {
     md = new GCMetaData();
     _lock = 0;
     id = tid++;
+#ifdef LOG_GARBAGE
+    get_garbage_log()->reset();
+#endif
 }
 
 thread_info::~thread_info() {
@@ -202,15 +271,29 @@ thread_info::~thread_info() {
     delete md;
 }
 
-void thread_info::AddGarbageNode(void *node_p) {
+void thread_info::AddGarbageNode(void *node_p, bool subtree) {
+#ifdef LOG_GARBAGE
+    if (md->log_tail - md->log_head == garbage_log_length) {
+        // the log is full, try to release the old entries first, otherwise
+        // this node is not logged and only leaks if the system crashes
+        PerformGC();
+    }
+#endif
     GarbageNode *garbage_node_p =
-        new GarbageNode(Epoch_Mgr::GetGlobalEpoch(), node_p);
+        new GarbageNode(Epoch_Mgr::GetGlobalEpoch(), node_p, subtree);
     assert(garbage_node_p != nullptr);
 
     // Link this new node to the end of the linked list
     // and then update last_p
     md->last_p->next_p = garbage_node_p;
     md->last_p = garbage_node_p;
+#ifdef LOG_GARBAGE
+    if (md->log_tail - md->log_head < garbage_log_length &&
+        get_garbage_log()->append(md->log_tail, node_p, subtree)) {
+        garbage_node_p->logged = true;
+        md->log_tail++;
+    }
+#endif
     //    PART_ns::BaseNode *n = (PART_ns::BaseNode *)node_p;
     //    std::cout << "[TEST]\tgarbage node type " << (int)(n->type) << "\n";
     // Update the counter
@@ -238,6 +321,19 @@ void thread_info::PerformGC() {
     GarbageNode *header_p = &(md->header);
     GarbageNode *first_p = header_p->next_p;
 
+#ifdef LOG_GARBAGE
+    // Drop the reclaimable nodes from the persistent garbage log before
+    // they are reused, a crash afterwards can only leak them
+    int logged_cnt = 0;
+    for (GarbageNode *p = first_p; p != nullptr && p->delete_epoch < min_epoch;
+         p = p->next_p) {
+        if (p->logged)
+            logged_cnt++;
+    }
+    get_garbage_log()->release(md->log_head, logged_cnt);
+    md->log_head += logged_cnt;
+#endif
+
     // Then traverse the linked list
     // Only reclaim memory when the deleted epoch < min epoch
     while (first_p != nullptr && first_p->delete_epoch < min_epoch) {
@@ -246,7 +342,10 @@ void thread_info::PerformGC() {
         header_p->next_p = first_p->next_p;
 
         // Then free memory
-        FreeEpochNode(first_p->node_p);
+        if (first_p->subtree)
+            FreeEpochSubtree(first_p->node_p);
+        else
+            FreeEpochNode(first_p->node_p);
 
         delete first_p;
         assert(md->node_count != 0UL);
@@ -266,6 +365,7 @@ void thread_info::PerformGC() {
 
 void thread_info::FreeEpochNode(void *node_p) {
     PART_ns::BaseNode *n = reinterpret_cast<PART_ns::BaseNode *>(node_p);
+    COUNT_PERSIST_EVENT(gc_free, 1);
 
     if (n->type == PART_ns::NTypes::Leaf) {
         // reclaim leaf key
@@ -284,6 +384,39 @@ void thread_info::FreeEpochNode(void *node_p) {
     }
 }
 
+void thread_info::FreeEpochSubtree(void *node_p) {
+    PART_ns::BaseNode *n = reinterpret_cast<PART_ns::BaseNode *>(node_p);
+    if (n->type == PART_ns::NTypes::Leaf) {
+        FreeEpochNode(node_p);
+        return;
+    }
+    if (n->type == PART_ns::NTypes::LeafArray) {
+        auto la = reinterpret_cast<PART_ns::LeafArray *>(node_p);
+        auto leaves = la->getSortedLeaf(nullptr, nullptr, 0, false, false);
+        for (PART_ns::Leaf *leaf : leaves)
+            if (!la->isInline(leaf))
+                FreeEpochNode((void *)leaf);
+        FreeEpochNode(node_p);
+        return;
+    }
+    PART_ns::N *node = reinterpret_cast<PART_ns::N *>(node_p);
+#ifdef INSTANT_RESTART
+    // the children of a node retired before a restart
+    node->check_generation();
+#endif
+    std::tuple<uint8_t, PART_ns::N *> children[256];
+    uint32_t childrenCount = 0;
+    PART_ns::N::getChildren(node, 0u, 255u, children, childrenCount);
+    for (uint32_t i = 0; i < childrenCount; ++i) {
+        // a leaf or a leaf array, told apart by its type
+        PART_ns::N *child = std::get<1>(children[i]);
+        if (PART_ns::N::isLeaf(child))
+            child = (PART_ns::N *)PART_ns::N::getLeaf(child);
+        FreeEpochSubtree((void *)child);
+    }
+    FreeEpochNode(node_p);
+}
+
 void *alloc_new_node_from_type(PART_ns::NTypes type) {
 #ifdef COUNT_ALLOC
     if (dcmm_time == nullptr)
@@ -345,6 +478,18 @@ void register_threadinfo() {
         epoch_mgr->StartThread();
         std::cout << "[THREAD]\tfirst new epoch_mgr and add global epoch\n";
     }
+    if (ti == nullptr && !free_ti_list.empty()) {
+        // reuse the thread info of an exited thread, the new thread also
+        // takes over its free lists and the garbage not reclaimed yet
+        ti = free_ti_list.back();
+        free_ti_list.pop_back();
+#ifdef QSBR
+        ti->QuiescentState();
+#endif
+        ti->next = ti_list_head;
+        ti_list_head = ti;
+        std::cout << "[THREAD]\treuse thread info " << ti->id << "\n";
+    }
     if (ti == nullptr) {
         if (tid == NVMMgr::max_threads) {
             std::cout << "[THREAD]\tno available threadinfo to allocate\n";
@@ -355,12 +500,37 @@ void register_threadinfo() {
         //        "<<mgr->meta_data<<"\n";
 
         ti = new (mgr->alloc_thread_info()) thread_info();
+#ifdef QSBR
+        // a registered thread is online until it goes offline explicitly
+        ti->QuiescentState();
+#endif
         ti->next = ti_list_head;
         ti_list_head = ti;
 
         // persist thread info
         flush_data((void *)ti, 128);
         std::cout << "[THREAD]\talloc thread info " << ti->id << "\n";
+
+#ifdef LOG_GARBAGE
+        // reclaim the nodes retired but not freed before the last restart
+        if (!mgr->recovered_garbage.empty() ||
+            !mgr->recovered_subtrees.empty()) {
+            for (uint64_t addr : mgr->recovered_garbage) {
+                ti->FreeEpochNode((void *)addr);
+            }
+            for (uint64_t addr : mgr->recovered_subtrees) {
+                ti->FreeEpochSubtree((void *)addr);
+            }
+            std::cout << "[THREAD]\treclaim " << mgr->recovered_garbage.size()
+                      << " retired nodes and "
+                      << mgr->recovered_subtrees.size()
+                      << " subtrees from garbage log\n";
+            mgr->recovered_garbage.clear();
+            mgr->recovered_garbage.shrink_to_fit();
+            mgr->recovered_subtrees.clear();
+            mgr->recovered_subtrees.shrink_to_fit();
+        }
+#endif
     }
 }
 
@@ -383,6 +553,8 @@ void unregister_threadinfo() {
     }
     std::cout << "[THREAD]\tunregister thread\n";
     //    delete ti;
+    ti->LeaveEpoch();
+    free_ti_list.push_back(ti);
     ti = nullptr;
     if (ti_list_head == nullptr) {
         // reset all, only use for gtest
@@ -391,6 +563,7 @@ void unregister_threadinfo() {
         delete pmblock;
         pmblock = nullptr;
         tid = 0;
+        free_ti_list.clear();
     }
 }
 
@@ -400,8 +573,18 @@ void JoinNewEpoch() { ti->JoinEpoch(); }
 
 void LeaveThisEpoch() { ti->LeaveEpoch(); }
 
+#ifdef QSBR
+void QuiescentState() { ti->QuiescentState(); }
+
+void ThreadOnline() { ti->QuiescentState(); }
+
+void ThreadOffline() { ti->LeaveEpoch(); }
+#endif
+
 void MarkNodeGarbage(void *node) { ti->AddGarbageNode(node); }
 
+void MarkSubtreeGarbage(void *node) { ti->AddGarbageNode(node, true); }
+
 uint64_t SummarizeGCEpoch() {
     assert(ti_list_head);
 
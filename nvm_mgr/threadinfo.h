@@ -11,6 +11,7 @@
 #include "pmalloc_wrap.h"
 #include "tbb/concurrent_queue.h"
 #include <list>
+#include <vector>
 
 namespace NVMMgr_ns {
 /*
@@ -35,6 +36,7 @@ namespace NVMMgr_ns {
 //} __attribute__((aligned(64)));
 
 const static int free_list_number = 10; // from 8byte to 4K
+const static size_t max_alloc_size = 4096; // the largest size of alloc_node
 // maintain free memory like buddy system in linux
 class buddy_allocator {
   private:
@@ -56,6 +58,49 @@ class buddy_allocator {
     int get_freelist_size(int id) { return free_list[id].unsafe_size(); }
 };
 
+#ifdef LOG_GARBAGE
+// compact leaves are 16 byte aligned, and a slot needs a spare bit for
+// subtrees, so a slot keeps the byte offset; a subtree takes one slot, the
+// log is not filled by retiring a large range
+typedef uint64_t garbage_slot_t;
+const static uint64_t garbage_log_unit = 1;
+const static int garbage_log_length = 4032 / sizeof(garbage_slot_t);
+// set in the slot of a subtree root
+const static garbage_slot_t garbage_subtree_bit = 1ULL << 63;
+
+/*
+ * Persistent garbage log
+ *
+ * A node retired by EpochGuard::DeleteNode is unreachable from the tree but
+ * still marked as used, so if the system crashes before the epoch GC frees
+ * it, it is leaked until a full traversal. Each thread records its retired
+ * nodes in the static log of its persistent thread_info, and the log is
+ * scanned when the NVM manager is reopened.
+ *
+ * The log is a ring of slots, each slot keeps the offset of a node from
+ * NVMMgr::start_addr in garbage_log_unit, and 0 means an empty slot. The
+ * ring positions are volatile (GCMetaData) since after a crash every non-zero
+ * slot is a retired but not reclaimed node. The slot of an unlinked subtree
+ * has garbage_subtree_bit set and only keeps its root, everything below the
+ * root is reclaimed with it. A slot is cleared and persisted
+ * before the node is inserted into the free list, thus a node is never
+ * reclaimed twice.
+ */
+class GarbageLog {
+    garbage_slot_t slots[garbage_log_length];
+
+  public:
+    void reset();
+    // return false if the node can not be logged
+    bool append(uint64_t pos, void *node, bool subtree);
+    // clear [pos, pos + cnt) slots of the ring and persist them
+    void release(uint64_t pos, int cnt);
+    // get all logged nodes and subtree roots
+    void collect(std::vector<uint64_t> &nodes,
+                 std::vector<uint64_t> &subtrees) const;
+};
+#endif
+
 class thread_info {
   public:
     int id;
@@ -83,6 +128,9 @@ class thread_info {
     ~thread_info();
 
     void *get_static_log() { return (void *)static_log; }
+#ifdef LOG_GARBAGE
+    GarbageLog *get_garbage_log() { return (GarbageLog *)static_log; }
+#endif
     int get_thread_id() { return id; }
     inline void JoinEpoch() {
         md->last_active_epoch = Epoch_Mgr::GetGlobalEpoch();
@@ -93,6 +141,17 @@ class thread_info {
         md->last_active_epoch = static_cast<uint64_t>(-1);
     }
 
+#ifdef QSBR
+    // The thread holds no reference to the tree, so nodes retired before
+    // this epoch are safe to free once every online thread passes it. Only
+    // write the shared metadata when the global epoch moves on.
+    inline void QuiescentState() {
+        uint64_t e = Epoch_Mgr::GetGlobalEpoch();
+        if (md->last_active_epoch != e)
+            md->last_active_epoch = e;
+    }
+#endif
+
     /*
      * AddGarbageNode() - Adds a garbage node into the thread-local GC context
      *
@@ -103,7 +162,7 @@ class thread_info {
      * do not have to worry about thread identity issues
      */
 
-    void AddGarbageNode(void *node_p);
+    void AddGarbageNode(void *node_p, bool subtree = false);
 
     /*
      * PerformGC() - This function performs GC on the current thread's garbage
@@ -118,6 +177,8 @@ class thread_info {
      */
     void PerformGC();
     void FreeEpochNode(void *node_p);
+    // free node_p and every node and leaf below it
+    void FreeEpochSubtree(void *node_p);
 
 } __attribute__((aligned(64)));
 
@@ -125,10 +186,12 @@ class thread_info {
 double getdcmmalloctime();
 #endif
 
-#ifdef INSTANT_RESTART
+// per-thread operation counters for the benchmark monitor
 void init();
 void increase(int id);
 uint64_t total(int thread_num);
+
+#ifdef INSTANT_RESTART
 uint64_t get_threadlocal_generation();
 #endif
 
@@ -139,7 +202,16 @@ void *get_threadinfo();
 
 void JoinNewEpoch();
 void LeaveThisEpoch();
+#ifdef QSBR
+// quiescent state based reclamation, a registered thread is online and must
+// announce quiescent states between operations, and go offline before
+// blocking for a long time
+void QuiescentState();
+void ThreadOnline();
+void ThreadOffline();
+#endif
 void MarkNodeGarbage(void *node);
+void MarkSubtreeGarbage(void *node);
 uint64_t SummarizeGCEpoch();
 
 size_t size_align(size_t s, int align);
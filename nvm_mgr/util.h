@@ -63,12 +63,60 @@ static __always_inline uint64_t rdtsc() {
 
 #define CACHE_ALIGN 64
 
+#ifdef COUNT_PERSIST
+/*
+ * Per-thread persistence counters, every thread only updates its own one.
+ * The benchmark reads the difference around an operation to get the
+ * persistence cost of the operation.
+ */
+struct PersistCounter {
+    uint64_t clwb;        // clwb or clflushopt
+    uint64_t clflush;     // clflush
+    uint64_t fence;       // mfence or sfence for persistence
+    uint64_t flush_bytes; // bytes of the flushed cache lines
+    uint64_t pm_block;    // blocks allocated from the NVM manager
+    uint64_t gc_free;     // nodes freed by the epoch GC
+    uint64_t help_flush;  // N::helpFlush calls
+
+    void operator+=(const PersistCounter &c) {
+        clwb += c.clwb;
+        clflush += c.clflush;
+        fence += c.fence;
+        flush_bytes += c.flush_bytes;
+        pm_block += c.pm_block;
+        gc_free += c.gc_free;
+        help_flush += c.help_flush;
+    }
+
+    // add the events happened between before and now
+    void add_delta(const PersistCounter &now, const PersistCounter &before) {
+        clwb += now.clwb - before.clwb;
+        clflush += now.clflush - before.clflush;
+        fence += now.fence - before.fence;
+        flush_bytes += now.flush_bytes - before.flush_bytes;
+        pm_block += now.pm_block - before.pm_block;
+        gc_free += now.gc_free - before.gc_free;
+        help_flush += now.help_flush - before.help_flush;
+    }
+};
+
+extern __thread PersistCounter persist_counter;
+
+#define COUNT_PERSIST_EVENT(field, n) (persist_counter.field += (n))
+#else
+#define COUNT_PERSIST_EVENT(field, n)
+#endif
+
 static void flush_data(void *addr, size_t len) {
     char *end = (char *)(addr) + len;
     char *ptr = (char *)((unsigned long)addr & ~(CACHE_ALIGN - 1));
-    for (; ptr < end; ptr += CACHE_ALIGN)
+    for (; ptr < end; ptr += CACHE_ALIGN) {
         asm_clwb(ptr);
+        COUNT_PERSIST_EVENT(clwb, 1);
+        COUNT_PERSIST_EVENT(flush_bytes, CACHE_ALIGN);
+    }
     asm_mfence();
+    COUNT_PERSIST_EVENT(fence, 1);
 }
 
 // prefetch instruction
@@ -1,5 +1,6 @@
 #include "nvm_mgr.h"
 #include "threadinfo.h"
+#include "topology.h"
 #include <boost/thread/barrier.hpp>
 #include <chrono>
 #include <iostream>
@@ -29,28 +30,10 @@ struct my_root {
 const int max_addr = 1000000;
 uint64_t addr[max_addr + 5];
 
-const int thread_to_core[36] = {
-        0,  4,  8,  12, 16, 20, 24, 28, 32,
-        36, 40, 44, 48, 52, 56, 60, 64, 68, // numa node 0
-        1,  5,  9,  13, 17, 21, 25, 29, 33,
-        37, 41, 45, 49, 53, 57, 61, 65, 69 // numa node 1
-};
-
 int stick_this_thread_to_core(int core_id) {
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-    if (core_id < 0 || core_id >= num_cores)
-        return EINVAL;
-
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(thread_to_core[core_id], &cpuset);
-
-    pthread_t current_thread = pthread_self();
-    return pthread_setaffinity_np(current_thread, sizeof(cpu_set_t),
-                                  &cpuset);
+    return pin_thread(core_id, PIN_SOCKET_FIRST);
 }
 
-
 int main(int argc, char **argv) {
     if (argc != 3) {
         usage();
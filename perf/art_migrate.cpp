@@ -0,0 +1,156 @@
+#include "Tree.h"
+#include "config.h"
+#include "nvm_mgr.h"
+#include <iostream>
+#include <limits>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+using namespace PART_ns;
+using namespace NVMMgr_ns;
+
+/*
+ * Move the keys of an ART pool into a pool of another node layout
+ *
+ * A build only reopens a pool of its own NVMMgr::node_layout, and the
+ * layouts can not be read by one build. dump, run by a build of the old
+ * layout, writes every key and value of the pool to a file:
+ *
+ * | header | key_len | val_len | key | value | key_len | ... |
+ *
+ * load, run by a build of the new layout, inserts them into a new pool.
+ */
+struct DumpHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_layout; // of the dumped pool
+    uint64_t count;       // key-value pairs
+};
+
+static const char dump_magic[8] = {'A', 'R', 'T', 'D', 'U', 'M', 'P', 0};
+static const uint32_t dump_version = 1;
+
+void usage() {
+    cout << "usage: ./art_migrate dump [file] | load [file]\n"
+         << "dump writes every key and value of the pool " << nvm_dir
+         << "part.data to [file], load inserts them into that pool\n"
+         << "a pool of another node layout is migrated by: dump with a "
+            "build of its layout, move the pool away, load with the new "
+            "build\n";
+}
+
+int dump(const char *filename) {
+    if (access(NVMMgr::get_filename(), F_OK) != 0) {
+        cout << "[MIGRATE]\tno pool " << NVMMgr::get_filename() << "\n";
+        return 1;
+    }
+    // a pool of another layout is refused before the file is created
+    Tree *art = new Tree();
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) {
+        cout << "[MIGRATE]\tfailed to create " << filename << "\n";
+        delete art;
+        return 1;
+    }
+    DumpHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, dump_magic, sizeof(h.magic));
+    h.version = dump_version;
+    h.node_layout = NVMMgr::node_layout;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+    // the empty prefix streams the whole tree in key order
+    char empty = 0;
+    Key prefix;
+    prefix.Init(&empty, 0, nullptr, 0);
+    art->scanPrefix(&prefix, [&](Leaf *leaf) {
+        uint32_t len[2] = {(uint32_t)leaf->key_len, (uint32_t)leaf->val_len};
+        ok = ok && fwrite(len, sizeof(len), 1, f) == 1 &&
+             fwrite(leaf->GetKey(), 1, len[0], f) == len[0] &&
+             fwrite(leaf->GetValue(), 1, len[1], f) == len[1];
+        h.count++;
+        return ok;
+    });
+    delete art;
+
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        cout << "[MIGRATE]\tfailed to write " << filename << "\n";
+        return 1;
+    }
+    cout << "[MIGRATE]\tdump " << h.count << " keys of node layout "
+         << h.node_layout << " to " << filename << "\n";
+    return 0;
+}
+
+int load(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        cout << "[MIGRATE]\tfailed to open " << filename << "\n";
+        return 1;
+    }
+    DumpHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, dump_magic, sizeof(h.magic)) != 0 ||
+        h.version != dump_version) {
+        cout << "[MIGRATE]\t" << filename << " is not a dump of version "
+             << dump_version << "\n";
+        fclose(f);
+        return 1;
+    }
+
+    Tree *art = new Tree();
+    std::string key, value;
+    uint64_t inserted = 0, existed = 0, skipped = 0, i = 0;
+    for (; i < h.count; i++) {
+        uint32_t len[2];
+        if (fread(len, sizeof(len), 1, f) != 1)
+            break;
+        key.resize(len[0]);
+        value.resize(len[1]);
+        if ((len[0] > 0 && fread(&key[0], 1, len[0], f) != len[0]) ||
+            (len[1] > 0 && fread(&value[0], 1, len[1], f) != len[1]))
+            break;
+        if (len[0] == 0 || !Leaf::fits(len[0], len[1])) {
+            // does not fit into a leaf of this layout
+            skipped++;
+            continue;
+        }
+        Key k;
+        k.Init(&key[0], key.size(), &value[0], value.size());
+        if (art->insert(&k) == Tree::OperationResults::Success)
+            inserted++;
+        else
+            existed++;
+    }
+    delete art;
+    fclose(f);
+
+    cout << "[MIGRATE]\tload " << inserted << " keys of node layout "
+         << h.node_layout << " into node layout " << NVMMgr::node_layout
+         << ", " << existed << " existed, " << skipped << " too long\n";
+    if (i != h.count) {
+        cout << "[MIGRATE]\t" << filename << " ends after " << i << " of "
+             << h.count << " keys\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        usage();
+        return 1;
+    }
+    string mode = argv[1];
+    if (mode == "dump")
+        return dump(argv[2]);
+    if (mode == "load")
+        return load(argv[2]);
+    usage();
+    return 1;
+}
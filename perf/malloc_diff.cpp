@@ -1,3 +1,6 @@
+#include "N.h"
+#include "nvm_mgr.h"
+#include "threadinfo.h"
 #include "util.h"
 #include <chrono>
 #include <iostream>
@@ -23,8 +26,25 @@ void usage() {
     cout << "lack of parameters, please input ./malloc_diff [t] [size]\n"
          << "[t] is the type of test\n"
          << "0: new/libvmmalloc, 1: pmemobj_alloc, 2: tx+pmemobj_alloc, 3: "
-            "pmdk transactional allocator\n"
-         << "[size] is the size of allocated block\n";
+            "pmdk transactional allocator, 4: bytes per key of an ART leaf\n"
+         << "[size] is the size of allocated block, the value size for 4\n";
+}
+
+// the persistent bytes one leaf takes for some key lengths, the header is
+// everything before the key, the allocation is rounded up by the allocator
+void leaf_size(size_t val_len) {
+    NVMMgr_ns::init_nvm_mgr();
+    NVMMgr_ns::register_threadinfo();
+    cout << "leaf header " << sizeof(PART_ns::Leaf) << " bytes, value "
+         << val_len << " bytes\n";
+    for (size_t key_len : {8, 16, 32}) {
+        size_t size = sizeof(PART_ns::Leaf) + key_len + val_len;
+        cout << "key " << key_len << " bytes: leaf " << size
+             << " bytes, allocated " << NVMMgr_ns::convert_power_two(size)
+             << " bytes per key\n";
+    }
+    NVMMgr_ns::unregister_threadinfo();
+    NVMMgr_ns::close_nvm_mgr();
 }
 
 int main(int argc, char **argv) {
@@ -37,6 +57,11 @@ int main(int argc, char **argv) {
     size_t nsize = atoi(argv[2]);
     int test_iter = 1000000;
 
+    if (type == 4) {
+        leaf_size(nsize);
+        return 0;
+    }
+
     system("rm -rf /mnt/pmem0/matianmao/test_alloc.data");
     const char *pool_name = "/mnt/pmem0/matianmao/test_alloc.data";
     const char *layout_name = "pmdk-alloc";
@@ -0,0 +1,402 @@
+#include "EpochGuard.h"
+#include "LeafArray.h"
+#include "N16.h"
+#include "N256.h"
+#include "N4.h"
+#include "N48.h"
+#include "Tree.h"
+#include "config.h"
+#include "nvm_mgr.h"
+#include "threadinfo.h"
+#include "util.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+using namespace PART_ns;
+using namespace NVMMgr_ns;
+
+// time the building blocks of ART in isolation, in cycles per operation
+void usage() {
+    cout << "usage: ./node_bench [rounds] [filter]\n"
+         << "[rounds] is the number of operations of every measurement "
+            "(default 1000000)\n"
+         << "[filter] only runs the primitives containing it, e.g. getChild\n";
+}
+
+static volatile uint64_t sink;
+static long rounds = 1000000;
+static string filter;
+static mt19937_64 rng(42);
+
+static const int query_mask = 4095; // pre-generated random queries
+
+static bool enabled(const string &primitive) {
+    return filter.empty() || primitive.find(filter) != string::npos;
+}
+
+static void report(const string &primitive, const string &param,
+                   uint64_t cycles, long ops) {
+    printf("[NODE BENCH]\t%-28s %-20s %10.1lf cycles/op\n", primitive.c_str(),
+           param.c_str(), (double)cycles / ops);
+}
+
+static string param(const char *name, int v) {
+    return string(name) + " " + to_string(v);
+}
+
+// the key bytes of a node with fill children are spread over 0..255
+static uint8_t key_byte(int i, int fill) { return (uint8_t)(i * 256 / fill); }
+
+// children are never followed, only their pointers are stored
+static N *fake_child(int i) {
+    return N::setLeaf((Leaf *)(uintptr_t)((i + 1) << 6));
+}
+
+// a node of every type is filled to these levels
+struct NodeKind {
+    const char *name;
+    NTypes type;
+    vector<int> fills;
+};
+
+static const NodeKind node_kinds[] = {
+    {"N4", NTypes::N4, {1, 2, 4}},
+    {"N16", NTypes::N16, {5, 8, 16}},
+    {"N48", NTypes::N48, {17, 32, 48}},
+    {"N256", NTypes::N256, {49, 128, 256}},
+};
+
+static N *construct(NTypes type, void *addr, uint32_t level,
+                    const uint8_t *prefix, uint32_t prefix_len) {
+    switch (type) {
+    case NTypes::N4:
+        return new (addr) N4(level, prefix, prefix_len);
+    case NTypes::N16:
+        return new (addr) N16(level, prefix, prefix_len);
+    case NTypes::N48:
+        return new (addr) N48(level, prefix, prefix_len);
+    default:
+        return new (addr) N256(level, prefix, prefix_len);
+    }
+}
+
+static bool insert_child(N *n, uint8_t key, N *child, bool flush) {
+    switch (n->getType()) {
+    case NTypes::N4:
+        return static_cast<N4 *>(n)->insert(key, child, flush);
+    case NTypes::N16:
+        return static_cast<N16 *>(n)->insert(key, child, flush);
+    case NTypes::N48:
+        return static_cast<N48 *>(n)->insert(key, child, flush);
+    default:
+        return static_cast<N256 *>(n)->insert(key, child, flush);
+    }
+}
+
+static N *make_node(NTypes type, int fill) {
+    N *n = construct(type, alloc_new_node_from_type(type), 0, nullptr, 0);
+    for (int i = 0; i < fill; i++)
+        insert_child(n, key_byte(i, fill), fake_child(i), false);
+    return n;
+}
+
+void bench_inner_nodes() {
+    vector<uint8_t> queries(query_mask + 1);
+    std::tuple<uint8_t, N *> children[256];
+
+    for (const NodeKind &kind : node_kinds) {
+        for (int fill : kind.fills) {
+            string name = kind.name;
+            N *n = make_node(kind.type, fill);
+            for (auto &q : queries)
+                q = key_byte(rng() % fill, fill);
+
+            if (enabled(name + "::getChild")) {
+                uint64_t start = rdtsc();
+                for (long i = 0; i < rounds; i++)
+                    sink += (uint64_t)N::getChild(queries[i & query_mask], n);
+                report(name + "::getChild", param("fill", fill),
+                       rdtsc() - start, rounds);
+            }
+
+            if (enabled(name + "::getChildren")) {
+                long calls = rounds / 16 + 1;
+                uint64_t start = rdtsc();
+                for (long i = 0; i < calls; i++) {
+                    uint32_t count = 0;
+                    N::getChildren(n, 0, 255, children, count);
+                    sink += count;
+                }
+                report(name + "::getChildren", param("fill", fill),
+                       rdtsc() - start, calls);
+            }
+
+            if (enabled(name + "::insert")) {
+                // every round fills a new node, the construction is not timed
+                long nodes = rounds / fill + 1;
+                uint64_t cycles = 0;
+                void *addr = alloc_new_node_from_type(kind.type);
+                for (long r = 0; r < nodes; r++) {
+                    N *m = construct(kind.type, addr, 0, nullptr, 0);
+                    uint64_t start = rdtsc();
+                    for (int i = 0; i < fill; i++)
+                        insert_child(m, key_byte(i, fill), fake_child(i),
+                                     true);
+                    cycles += rdtsc() - start;
+                }
+                report(name + "::insert", param("fill", fill), cycles,
+                       nodes * fill);
+            }
+        }
+    }
+}
+
+// key_len random bytes after first, the keys of one leaf array
+static vector<string> make_keys(int count, int key_len, uint8_t first) {
+    vector<string> keys;
+    for (int i = 0; i < count; i++) {
+        string s(key_len, '\0');
+        s[0] = first;
+        for (int j = 1; j < key_len; j++)
+            s[j] = 'a' + rng() % 26;
+        keys.push_back(s);
+    }
+    return keys;
+}
+
+static vector<Leaf *> make_leaves(Tree *tree, vector<string> &keys) {
+    char value[8] = "value";
+    vector<Leaf *> leaves;
+    for (string &s : keys) {
+        Key k;
+        k.Init((char *)s.data(), s.size(), value, sizeof(value));
+        leaves.push_back(tree->allocLeaf(&k));
+    }
+    return leaves;
+}
+
+void bench_leaf_array(Tree *tree) {
+    const int key_lens[] = {8, 16, 32, 64};
+    const int fills[] = {8, 32, (int)LeafArrayLength};
+    char value[8] = "value";
+
+    for (int key_len : key_lens) {
+        vector<string> keys = make_keys(LeafArrayLength, key_len, 'k');
+        vector<Leaf *> leaves = make_leaves(tree, keys);
+
+        for (int fill : fills) {
+            string p = param("fill", fill) + ", " + param("key", key_len);
+            LeafArray *la = new (alloc_new_node_from_type(NTypes::LeafArray))
+                LeafArray(0);
+            for (int i = 0; i < fill; i++)
+                la->insert(leaves[i], false);
+
+            if (enabled("LeafArray::lookup")) {
+                vector<Key> queries(query_mask + 1);
+                for (auto &q : queries) {
+                    string &s = keys[rng() % fill];
+                    q.Init((char *)s.data(), s.size(), value, sizeof(value));
+                }
+                uint64_t start = rdtsc();
+                for (long i = 0; i < rounds; i++)
+                    sink += (uint64_t)la->lookup(&queries[i & query_mask]);
+                report("LeafArray::lookup", p, rdtsc() - start, rounds);
+            }
+
+            if (enabled("LeafArray::insert")) {
+                long arrays = rounds / fill + 1;
+                uint64_t cycles = 0;
+                void *addr = alloc_new_node_from_type(NTypes::LeafArray);
+                for (long r = 0; r < arrays; r++) {
+                    LeafArray *m = new (addr) LeafArray(0);
+                    uint64_t start = rdtsc();
+                    for (int i = 0; i < fill; i++)
+                        m->insert(leaves[i], true);
+                    cycles += rdtsc() - start;
+                }
+                report("LeafArray::insert", p, cycles, arrays * fill);
+            }
+        }
+
+        if (enabled("LeafArray::splitAndUnlock")) {
+            // a full leaf array under a N4 is split into a new inner node of
+            // leaf arrays, every split allocates new nodes which are never
+            // freed, so there are fewer rounds
+            long splits = rounds / 10000 + 1;
+            uint64_t cycles = 0;
+            for (long r = 0; r < splits; r++) {
+                EpochGuard NewEpoch;
+                N *parent = make_node(NTypes::N4, 0);
+                LeafArray *la = new (alloc_new_node_from_type(
+                    NTypes::LeafArray)) LeafArray(1);
+                for (Leaf *l : leaves)
+                    la->insert(l, false);
+                insert_child(parent, 'k', N::setLeafArray(la), false);
+
+                bool need_restart = false;
+                uint64_t start = rdtsc();
+                la->writeLockOrRestart(need_restart);
+                la->splitAndUnlock(parent, 'k', need_restart);
+                cycles += rdtsc() - start;
+            }
+            report("LeafArray::splitAndUnlock", param("key", key_len), cycles,
+                   splits);
+        }
+    }
+}
+
+void bench_prefix_and_key() {
+    const int prefix_lens[] = {0, 2, 4, 8};
+    const int key_lens[] = {8, 16, 32, 64, 128};
+    char value[8] = "value";
+
+    for (int prefix_len : prefix_lens) {
+        if (!enabled("checkPrefix"))
+            break;
+        string s = make_keys(1, 16, 'k')[0];
+        Key k;
+        k.Init((char *)s.data(), s.size(), value, sizeof(value));
+        // the node is at the level after its prefix, the prefix matches
+        N *n = construct(NTypes::N4, alloc_new_node_from_type(NTypes::N4),
+                         prefix_len, (const uint8_t *)s.data(), prefix_len);
+        uint64_t start = rdtsc();
+        for (long i = 0; i < rounds; i++) {
+            uint32_t level = 0;
+            sink += (uint64_t)Tree::checkPrefix(n, &k, level) + level;
+        }
+        report("Tree::checkPrefix", param("prefix", prefix_len),
+               rdtsc() - start, rounds);
+    }
+
+    for (int key_len : key_lens) {
+        if (!enabled("Key::getFingerPrint"))
+            break;
+        string s = make_keys(1, key_len, 'k')[0];
+        Key k;
+        k.Init((char *)s.data(), s.size(), value, sizeof(value));
+        uint64_t start = rdtsc();
+        for (long i = 0; i < rounds; i++) {
+            sink += k.getFingerPrint();
+            asm volatile("" ::: "memory"); // the key may change
+        }
+        report("Key::getFingerPrint", param("key", key_len), rdtsc() - start,
+               rounds);
+    }
+}
+
+// the byte loops of Key and Leaf against the words of FixedKey, the tree
+// uses FixedKey when it is built with FIXED_KEY_LEN
+template <size_t key_len> void bench_fixed_key(Tree *tree) {
+    char value[8] = "value";
+    vector<string> keys = make_keys(1, key_len, 'k');
+    Leaf *leaf = make_leaves(tree, keys)[0];
+    // an equal key in another buffer
+    string s = keys[0];
+    Key k;
+    k.Init((char *)s.data(), s.size(), value, sizeof(value));
+
+    if (enabled("Leaf::checkKey")) {
+        uint64_t start = rdtsc();
+        for (long i = 0; i < rounds; i++) {
+            sink += leaf->checkKey(&k);
+            asm volatile("" ::: "memory");
+        }
+        report("Leaf::checkKey", param("key", key_len), rdtsc() - start,
+               rounds);
+    }
+
+    if (enabled("FixedKey::equal")) {
+        uint64_t start = rdtsc();
+        for (long i = 0; i < rounds; i++) {
+            sink += FixedKey<key_len>::equal(leaf->GetKey(), k.fkey);
+            asm volatile("" ::: "memory");
+        }
+        report("FixedKey::equal", param("key", key_len), rdtsc() - start,
+               rounds);
+    }
+
+    if (enabled("FixedKey::fingerPrint")) {
+        uint64_t start = rdtsc();
+        for (long i = 0; i < rounds; i++) {
+            sink += FixedKey<key_len>::fingerPrint(k.fkey);
+            asm volatile("" ::: "memory");
+        }
+        report("FixedKey::fingerPrint", param("key", key_len),
+               rdtsc() - start, rounds);
+    }
+}
+
+void bench_persist_and_alloc() {
+    const int sizes[] = {64, 256, 1024, 4096};
+
+    for (int size : sizes) {
+        if (!enabled("flush_data"))
+            break;
+        char *block = (char *)alloc_new_node_from_size(size);
+        long flushes = rounds / (size / 64) + 1;
+        uint64_t start = rdtsc();
+        for (long i = 0; i < flushes; i++) {
+            block[0] = (char)i;
+            flush_data(block, size);
+        }
+        report("flush_data", param("bytes", size), rdtsc() - start, flushes);
+        free_node_from_size((uint64_t)block, size);
+    }
+
+    for (int size : sizes) {
+        if (!enabled("buddy_allocator::alloc_node"))
+            break;
+        // allocate a batch and give it back untimed, so that the free lists
+        // and the pool do not run out
+        const long batch = 4096;
+        vector<uint64_t> blocks(batch);
+        long allocs = 0;
+        uint64_t cycles = 0;
+        while (allocs < rounds) {
+            uint64_t start = rdtsc();
+            for (long i = 0; i < batch; i++)
+                blocks[i] = (uint64_t)alloc_new_node_from_size(size);
+            cycles += rdtsc() - start;
+            for (long i = 0; i < batch; i++)
+                free_node_from_size(blocks[i], size);
+            allocs += batch;
+        }
+        report("buddy_allocator::alloc_node", param("bytes", size), cycles,
+               allocs);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        usage();
+        return 1;
+    }
+    if (argc > 1)
+        rounds = atol(argv[1]);
+    if (argc > 2)
+        filter = argv[2];
+    if (rounds <= 0) {
+        usage();
+        return 1;
+    }
+
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+    // the tree sets up the nvm manager and the thread info of this thread
+    Tree *tree = new Tree();
+
+    bench_inner_nodes();
+    bench_leaf_array(tree);
+    bench_prefix_and_key();
+    bench_fixed_key<8>(tree);
+    bench_fixed_key<16>(tree);
+    bench_fixed_key<32>(tree);
+    bench_persist_and_alloc();
+
+    delete tree;
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+    return 0;
+}
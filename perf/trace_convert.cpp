@@ -0,0 +1,85 @@
+#include "microbench.h"
+#include "trace.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+// convert a text trace into the binary trace of the trace benchmark
+void usage() {
+    cout << "usage: ./trace_convert [key type] [input] [output]\n"
+         << "[key type] is 0 (Integer) or 1 (String)\n"
+         << "every line of [input] is an operation: op key [value size]\n"
+         << "op is one of load, insert, remove, update, get, scan, the load "
+            "operations insert the initial keys before the run\n";
+}
+
+bool parse_op(const string &name, bool &load, uint8_t &op) {
+    load = false;
+    if (name == "load") {
+        load = true;
+        op = INSERT;
+    } else if (name == "insert") {
+        op = INSERT;
+    } else if (name == "remove" || name == "delete") {
+        op = REMOVE;
+    } else if (name == "update") {
+        op = UPDATE;
+    } else if (name == "get" || name == "read") {
+        op = GET;
+    } else if (name == "scan") {
+        op = SCAN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        usage();
+        return 1;
+    }
+    KeyType key_type = (KeyType)atoi(argv[1]);
+    ifstream fin(argv[2]);
+    if (!fin) {
+        cout << "[TRACE]\tfailed to open " << argv[2] << "\n";
+        return 1;
+    }
+
+    TraceWriter writer(key_type);
+    string line, name, key;
+    unsigned long long lines = 0;
+    while (getline(fin, line)) {
+        lines++;
+        istringstream in(line);
+        uint32_t value_size = 0;
+        if (!(in >> name >> key))
+            continue;
+        in >> value_size;
+
+        bool load;
+        uint8_t op;
+        if (!parse_op(name, load, op) || key.size() > UINT16_MAX) {
+            cout << "[TRACE]\tskip line " << lines << ": " << line << "\n";
+            continue;
+        }
+        if (key_type == Integer) {
+            long long d = strtoll(key.c_str(), NULL, 10);
+            writer.add(load, op, (char *)&d, sizeof(d), value_size);
+        } else {
+            writer.add(load, op, key.c_str(), key.size(), value_size);
+        }
+    }
+
+    if (!writer.write(argv[3])) {
+        cout << "[TRACE]\tfailed to write " << argv[3] << "\n";
+        return 1;
+    }
+    TraceFile *trace = TraceFile::open(argv[3]);
+    cout << "[TRACE]\twrite " << trace->load_count() << " load and "
+         << trace->run_count() << " run records to " << argv[3] << "\n";
+    return 0;
+}
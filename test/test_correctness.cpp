@@ -1,8 +1,10 @@
 #include "generator.h"
 #include "threadinfo.h"
+#include <algorithm>
 #include <boost/thread/barrier.hpp>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <map>
 #include <stdio.h>
 #include <stdlib.h>
 #include <thread>
@@ -385,4 +387,824 @@ TEST(TestCorrectness, PM_ART_INSERT_AND_READ) {
     std::cout << "passed test.....\n";
 
     delete art;
-}
\ No newline at end of file
+}
+TEST(TestCorrectness, PM_ART_UPSERT) {
+
+    std::cout << "[TEST]\tstart to test upsert\n";
+    clear_data();
+
+    const int nthreads = 4;
+    const int key_cnt = 300; // more than a leaf array
+    const int rmw_iter = 500;
+
+    Tree *art = new Tree();
+    std::vector<std::string> key_vec;
+    for (int i = 0; i < key_cnt; i++)
+        key_vec.push_back("ups" + std::to_string(100000 + i * 7) + "ert");
+
+    // insert, then replace and get a copy of the old value back
+    for (int round = 0; round < 3; round++) {
+        for (auto &key : key_vec) {
+            std::string value = key + std::to_string(round);
+            Key k;
+            k.Init((char *)key.c_str(), key.size(), (char *)value.c_str(),
+                   value.size());
+            std::string old = "none";
+            Tree::OperationResults res = art->upsert(&k, &old);
+            if (round == 0) {
+                ASSERT_EQ(res, Tree::OperationResults::Success);
+                ASSERT_EQ(old, "");
+            } else {
+                ASSERT_EQ(res, Tree::OperationResults::Existed);
+                ASSERT_EQ(old, key + std::to_string(round - 1));
+            }
+            Leaf *ret = art->lookup(&k);
+            ASSERT_TRUE(ret) << "key: " << key;
+            ASSERT_EQ(std::string(ret->GetValue(), ret->val_len), value);
+        }
+    }
+
+    // concurrent counters, every thread increments every key
+    auto increment = [](const Leaf *old, std::string &value) {
+        uint64_t n = 0;
+        if (old != nullptr && old->val_len == sizeof(uint64_t))
+            memcpy(&n, const_cast<Leaf *>(old)->GetValue(), sizeof(n));
+        n++;
+        value.assign((char *)&n, sizeof(n));
+        return true;
+    };
+    std::thread *tid[nthreads];
+    for (int i = 0; i < nthreads; i++) {
+        tid[i] = new std::thread(
+            [&](int id) {
+                NVMMgr_ns::register_threadinfo();
+                for (int j = 0; j < rmw_iter; j++) {
+                    std::string kk = "cnt" + std::to_string((j + id) % 100);
+                    Key k;
+                    k.Init((char *)kk.c_str(), kk.size(), nullptr, 0);
+                    Tree::OperationResults res =
+                        art->readModifyWrite(&k, increment);
+                    ASSERT_NE(res, Tree::OperationResults::UnSuccess);
+                }
+                NVMMgr_ns::unregister_threadinfo();
+            },
+            i);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        tid[i]->join();
+        delete tid[i];
+    }
+    uint64_t total = 0;
+    for (int j = 0; j < 100; j++) {
+        std::string kk = "cnt" + std::to_string(j);
+        Key k;
+        k.Init((char *)kk.c_str(), kk.size(), nullptr, 0);
+        Leaf *ret = art->lookup(&k);
+        ASSERT_TRUE(ret) << "key: " << kk;
+        uint64_t n;
+        memcpy(&n, ret->GetValue(), sizeof(n));
+        total += n;
+    }
+    ASSERT_EQ(total, (uint64_t)nthreads * rmw_iter);
+
+    // a declined modification leaves the key as it is
+    Key k;
+    k.Init((char *)key_vec[0].c_str(), key_vec[0].size(), nullptr, 0);
+    ASSERT_EQ(art->readModifyWrite(
+                  &k, [](const Leaf *, std::string &) { return false; }),
+              Tree::OperationResults::UnSuccess);
+    ASSERT_EQ(std::string(art->lookup(&k)->GetValue(), key_vec[0].size() + 1),
+              key_vec[0] + "2");
+
+    delete art;
+}
+
+#ifdef INPLACE_UPDATE
+TEST(TestCorrectness, PM_ART_INPLACE_UPDATE) {
+
+    std::cout << "[TEST]\tstart to test in-place update\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    // key lengths 5..12 put the value at every offset of a word
+    for (int len = 5; len <= 12; len++) {
+        std::string key = "inp" + std::string(len - 3, 'a' + len);
+        uint64_t value = 1;
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)&value, sizeof(value));
+        ASSERT_EQ(art->insert(&k), Tree::OperationResults::Success);
+        Leaf *leaf = art->lookup(&k);
+        bool aligned = (uintptr_t)leaf->GetValue() % sizeof(uint64_t) == 0;
+
+        value = 2;
+        ASSERT_EQ(art->update(&k), Tree::OperationResults::Success);
+        Leaf *ret = art->lookup(&k);
+        ASSERT_EQ(*(uint64_t *)ret->GetValue(), 2);
+        // only a value in one word is written in place
+        ASSERT_EQ(ret == leaf, aligned) << "key: " << key;
+
+        // a small value is written in place wherever it is
+        char c = 'x';
+        k.Init((char *)key.c_str(), key.size(), &c, 1);
+        ASSERT_EQ(art->update(&k), Tree::OperationResults::Success);
+        leaf = art->lookup(&k);
+        ASSERT_EQ(leaf->val_len, 1);
+        c = 'y';
+        ASSERT_EQ(art->update(&k), Tree::OperationResults::Success);
+        ret = art->lookup(&k);
+        ASSERT_EQ(ret, leaf);
+        ASSERT_EQ(ret->GetValue()[0], 'y');
+    }
+
+    // a missing key is not found and allocates nothing
+    std::string key = "inpmissing";
+    uint64_t value = 3;
+    Key k;
+    k.Init((char *)key.c_str(), key.size(), (char *)&value, sizeof(value));
+    ASSERT_EQ(art->update(&k), Tree::OperationResults::NotFound);
+    ASSERT_EQ(art->lookup(&k), nullptr);
+
+    delete art;
+}
+#endif
+
+TEST(TestCorrectness, PM_ART_HIGH_BYTE_KEYS) {
+
+    std::cout << "[TEST]\tstart to test keys with bytes above 0x7f\n";
+    clear_data();
+
+    // leaves and keys must agree on the fingerprint of every byte
+    Tree *art = new Tree();
+    char value[8] = "value";
+    for (uint64_t i = 0; i < 1000; i++) {
+        uint64_t kk = i * 0x0101010101010101ull;
+        Key k;
+        k.Init((char *)&kk, sizeof(kk), value, sizeof(value));
+        ASSERT_EQ(art->insert(&k), Tree::OperationResults::Success);
+    }
+    for (uint64_t i = 0; i < 1000; i++) {
+        uint64_t kk = i * 0x0101010101010101ull;
+        Key k;
+        k.Init((char *)&kk, sizeof(kk), value, sizeof(value));
+        ASSERT_TRUE(art->lookup(&k)) << "key " << i;
+    }
+
+    delete art;
+}
+
+#ifdef COMPACT_LEAF
+TEST(TestCorrectness, PM_ART_COMPACT_LEAF) {
+
+    std::cout << "[TEST]\tstart to test compact leaves\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    for (int len = 1; len <= 40; len++) {
+        std::string key = "compact" + std::string(len, 'a' + len % 26);
+        std::string value(len * 3, 'v');
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)value.data(),
+               value.size());
+        ASSERT_EQ(art->insert(&k), Tree::OperationResults::Success);
+
+        Leaf *leaf = art->lookup(&k);
+        ASSERT_NE(leaf, nullptr);
+        ASSERT_EQ(leaf->type, NTypes::Leaf);
+        ASSERT_EQ(leaf->format, CompactLeafFormat);
+        // the key follows the 8 byte header, the value follows the key
+        ASSERT_EQ(leaf->GetKey(), (char *)leaf + 8);
+        ASSERT_EQ(std::string(leaf->GetKey(), leaf->key_len), key);
+        ASSERT_EQ(std::string(leaf->GetValue(), leaf->val_len), value);
+        ASSERT_EQ(leaf->getFingerPrint(), k.getFingerPrint());
+        ASSERT_EQ(leaf->getFingerPrint(), leaf->computeFingerPrint());
+    }
+
+    delete art;
+}
+
+TEST(TestCorrectness, PM_ART_COMPACT_LEAF_TOO_LONG) {
+
+    std::cout << "[TEST]\tstart to test keys and values too long for a "
+                 "leaf\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    std::string key = "compact-long", value = "short";
+    std::string long_key(UINT16_MAX + 1, 'k');
+    std::string long_value(UINT16_MAX + 1, 'v');
+    Key k;
+    k.Init((char *)key.c_str(), key.size(), (char *)value.data(),
+           value.size());
+    ASSERT_EQ(art->insert(&k), Tree::OperationResults::Success);
+
+    // the lengths are refused before a leaf is allocated
+    k.Init((char *)key.c_str(), key.size(), (char *)long_value.data(),
+           long_value.size());
+    ASSERT_EQ(art->update(&k), Tree::OperationResults::UnSuccess);
+    ASSERT_EQ(art->upsert(&k), Tree::OperationResults::UnSuccess);
+    ASSERT_EQ(art->readModifyWrite(&k,
+                                   [&](const Leaf *, std::string &v) {
+                                       v = long_value;
+                                       return true;
+                                   }),
+              Tree::OperationResults::UnSuccess);
+    Leaf *leaf = art->lookup(&k);
+    ASSERT_NE(leaf, nullptr);
+    ASSERT_EQ(std::string(leaf->GetValue(), leaf->val_len), value);
+
+    k.Init((char *)long_key.c_str(), long_key.size(), (char *)value.data(),
+           value.size());
+    ASSERT_EQ(art->insert(&k), Tree::OperationResults::UnSuccess);
+    ASSERT_EQ(art->upsert(&k), Tree::OperationResults::UnSuccess);
+    ASSERT_EQ(art->lookup(&k), nullptr);
+
+    // the largest value that still fits
+    while (!Leaf::fits(key.size(), long_value.size()))
+        long_value.pop_back();
+    k.Init((char *)key.c_str(), key.size(), (char *)long_value.data(),
+           long_value.size());
+    ASSERT_EQ(art->upsert(&k), Tree::OperationResults::Existed);
+    leaf = art->lookup(&k);
+    ASSERT_NE(leaf, nullptr);
+    ASSERT_EQ(std::string(leaf->GetValue(), leaf->val_len), long_value);
+
+    delete art;
+}
+#endif
+
+// tenants share a long prefix, which is longer than the stored prefix of a
+// node, user ids spread over all byte values
+static std::string tenant_key(int tenant, int user) {
+    std::string key = "tenant-" + std::to_string(1000 + tenant) + "/";
+    key += (char)(user * 37 % 256);
+    key += std::to_string(user) + "$";
+    return key;
+}
+
+// insert 300 users of 20 tenants into art, returns their keys
+static std::set<std::string> insert_tenants(Tree *art) {
+    std::set<std::string> key_set;
+    for (int tenant = 0; tenant < 20; tenant++) {
+        for (int user = 0; user < 300; user++) {
+            std::string key = tenant_key(tenant, user);
+            key_set.insert(key);
+            Key k;
+            k.Init((char *)key.c_str(), key.size(), (char *)key.c_str(),
+                   key.size());
+            EXPECT_EQ(art->insert(&k), Tree::OperationResults::Success);
+        }
+    }
+    return key_set;
+}
+
+TEST(TestCorrectness, PM_ART_SCAN_PREFIX) {
+
+    std::cout << "[TEST]\tstart to test prefix scan\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    std::set<std::string> key_set = insert_tenants(art);
+
+    auto scan = [&](const std::string &prefix, size_t limit) {
+        std::vector<std::string> found;
+        Key k;
+        k.Init((char *)prefix.c_str(), prefix.size(), nullptr, 0);
+        size_t n = art->scanPrefix(&k, [&](Leaf *leaf) {
+            found.push_back(std::string(leaf->GetKey(), leaf->key_len));
+            return found.size() < limit;
+        });
+        EXPECT_EQ(n, found.size());
+        return found;
+    };
+    auto expected = [&](const std::string &prefix, size_t limit) {
+        std::vector<std::string> keys;
+        for (auto it = key_set.lower_bound(prefix);
+             it != key_set.end() && it->compare(0, prefix.size(), prefix) == 0 &&
+             keys.size() < limit;
+             ++it)
+            keys.push_back(*it);
+        return keys;
+    };
+
+    const char *prefixes[] = {"tenant-1007/", "tenant-101", "tenant-10",
+                              "ten",          "tenant-1019/\x25",
+                              "tenant-2",     "tenant-1007/\xff", "x"};
+    for (const char *p : prefixes) {
+        std::string prefix(p);
+        ASSERT_EQ(scan(prefix, SIZE_MAX), expected(prefix, SIZE_MAX))
+            << "prefix " << prefix;
+        ASSERT_EQ(scan(prefix, 10), expected(prefix, 10)) << "prefix " << prefix;
+    }
+    ASSERT_EQ(scan("tenant-", SIZE_MAX).size(), key_set.size());
+
+    delete art;
+}
+
+TEST(TestCorrectness, PM_ART_REVERSE_SCAN) {
+
+    std::cout << "[TEST]\tstart to test reverse scan\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    std::set<std::string> key_set = insert_tenants(art);
+
+    // the keys of [start, end) from the largest, an empty bound is open
+    auto scan = [&](const std::string &start, const std::string &end,
+                    size_t limit, bool &more) {
+        Key s, e;
+        s.Init((char *)start.c_str(), start.size(), nullptr, 0);
+        e.Init((char *)end.c_str(), end.size(), nullptr, 0);
+        std::vector<Leaf *> result(limit);
+        size_t count = 0;
+        more = art->lookupRangeReverse(start.empty() ? nullptr : &s,
+                                       end.empty() ? nullptr : &e,
+                                       result.data(), limit, count);
+        std::vector<std::string> found;
+        for (size_t i = 0; i < count; i++)
+            found.push_back(std::string(result[i]->GetKey(), result[i]->key_len));
+        return found;
+    };
+    auto expected = [&](const std::string &start, const std::string &end,
+                        size_t limit, bool &more) {
+        std::vector<std::string> keys;
+        auto it = end.empty() ? key_set.end() : key_set.lower_bound(end);
+        while (it != key_set.begin()) {
+            --it;
+            if (!start.empty() && *it < start)
+                break;
+            if (keys.size() == limit) {
+                more = true;
+                return keys;
+            }
+            keys.push_back(*it);
+        }
+        more = false;
+        return keys;
+    };
+
+    std::vector<std::pair<std::string, std::string>> ranges = {
+        {"", ""},
+        {"", "tenant-1007/\x25"},
+        {"tenant-1003/", "tenant-1007/\xff"},
+        {"tenant-1007/\x80", "tenant-1007/\x81"},
+        {"tenant-1019/", ""},
+        {"a", "b"},
+        {"tenant-1005/", "tenant-1004/"}};
+    for (auto &r : ranges) {
+        for (size_t limit : {(size_t)1, (size_t)10, (size_t)7000}) {
+            bool more, expected_more;
+            ASSERT_EQ(scan(r.first, r.second, limit, more),
+                      expected(r.first, r.second, limit, expected_more))
+                << r.first << " " << r.second << " " << limit;
+            ASSERT_EQ(more, expected_more);
+        }
+    }
+
+    // the iterator crosses batches, seekForPrev includes its key
+    Tree::ReverseIterator it(art, 7);
+    std::vector<std::string> all;
+    for (it.seekToLast(); it.valid(); it.prev())
+        all.push_back(std::string(it.leaf()->GetKey(), it.leaf()->key_len));
+    ASSERT_EQ(all, std::vector<std::string>(key_set.rbegin(), key_set.rend()));
+
+    for (const std::string &target :
+         {*std::next(key_set.begin(), 1234), std::string("tenant-1011/\x90"),
+          std::string("tenant-0"), std::string("zzz")}) {
+        Key k;
+        k.Init((char *)target.c_str(), target.size(), nullptr, 0);
+        it.seekForPrev(&k);
+        auto expect = key_set.upper_bound(target);
+        for (int i = 0; i < 20; i++, it.prev()) {
+            if (expect == key_set.begin()) {
+                ASSERT_FALSE(it.valid());
+                break;
+            }
+            --expect;
+            ASSERT_TRUE(it.valid());
+            ASSERT_EQ(std::string(it.leaf()->GetKey(), it.leaf()->key_len),
+                      *expect);
+        }
+    }
+
+    delete art;
+}
+
+TEST(TestCorrectness, PM_ART_REMOVE_RANGE) {
+
+    std::cout << "[TEST]\tstart to test range removal\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    std::set<std::string> key_set = insert_tenants(art);
+    auto insert = [&](const std::string &key) {
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)key.c_str(),
+               key.size());
+        return art->insert(&k);
+    };
+
+    auto remove_range = [&](const std::string &start, const std::string &end) {
+        Key s, e;
+        s.Init((char *)start.c_str(), start.size(), nullptr, 0);
+        e.Init((char *)end.c_str(), end.size(), nullptr, 0);
+        size_t n = art->removeRange(start.empty() ? nullptr : &s,
+                                    end.empty() ? nullptr : &e);
+        size_t expected = 0;
+        auto it = start.empty() ? key_set.begin() : key_set.lower_bound(start);
+        while (it != key_set.end() && (end.empty() || *it < end)) {
+            it = key_set.erase(it);
+            expected++;
+        }
+        EXPECT_EQ(n, expected) << start << " " << end;
+    };
+    auto check = [&]() {
+        std::vector<Leaf *> result(key_set.size() + 1);
+        size_t count = 0;
+        art->lookupRangeReverse(nullptr, nullptr, result.data(), result.size(),
+                                count);
+        std::vector<std::string> found;
+        for (size_t i = 0; i < count; i++)
+            found.push_back(std::string(result[i]->GetKey(), result[i]->key_len));
+        ASSERT_EQ(found,
+                  std::vector<std::string>(key_set.rbegin(), key_set.rend()));
+        for (int tenant = 0; tenant < 20; tenant++) {
+            for (int user = 0; user < 300; user += 7) {
+                std::string key = tenant_key(tenant, user);
+                Key k;
+                k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+                ASSERT_EQ(art->lookup(&k) != nullptr, key_set.count(key) == 1)
+                    << key;
+            }
+        }
+    };
+
+    // a whole tenant, then ranges which cut leaf arrays and tenants
+    remove_range("tenant-1007/", "tenant-1008/");
+    check();
+    remove_range("tenant-1003/\x80", "tenant-1005/\x10");
+    check();
+    remove_range("tenant-1011/5", "tenant-1011/\xf0");
+    check();
+    remove_range("tenant-1018/", "");
+    check();
+    remove_range("tenant-1001/", "tenant-1001/");
+    check();
+
+    // the emptied parts of the tree take new keys
+    for (int user = 0; user < 300; user++) {
+        key_set.insert(tenant_key(7, user));
+        ASSERT_EQ(insert(tenant_key(7, user)), Tree::OperationResults::Success);
+    }
+    check();
+
+    // removal races with inserts outside of the range
+    std::thread writer([&]() {
+        NVMMgr_ns::register_threadinfo();
+        for (int user = 300; user < 1300; user++)
+            ASSERT_EQ(insert(tenant_key(12, user)),
+                      Tree::OperationResults::Success);
+        NVMMgr_ns::unregister_threadinfo();
+    });
+    remove_range("tenant-1013/", "tenant-1017/");
+    writer.join();
+    for (int user = 300; user < 1300; user++)
+        key_set.insert(tenant_key(12, user));
+    check();
+
+    remove_range("", "");
+    ASSERT_TRUE(key_set.empty());
+    check();
+#ifdef LEAF_ARRAY
+    // the dropped subtrees leave no empty leaf arrays behind
+    size_t inner, arrays;
+    art->countNodes(inner, arrays);
+    ASSERT_EQ(inner, 1u);
+    ASSERT_EQ(arrays, 0u);
+#endif
+    ASSERT_EQ(insert(tenant_key(3, 3)), Tree::OperationResults::Success);
+
+    delete art;
+}
+
+#ifdef LEAF_ARRAY
+TEST(TestCorrectness, PM_ART_LEAF_ARRAY_MERGE) {
+
+    std::cout << "[TEST]\tstart to test leaf array merge\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    const int key_cnt = 20000;
+    std::vector<std::string> keys;
+    for (int i = 0; i < key_cnt; i++)
+        keys.push_back("merge" + std::to_string(i * 7919 % key_cnt) + "$");
+    auto insert = [&](const std::string &key) {
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)key.c_str(),
+               key.size());
+        return art->insert(&k);
+    };
+    auto remove = [&](const std::string &key) {
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+        return art->remove(&k);
+    };
+    auto check = [&](const std::set<std::string> &live) {
+        for (auto &key : keys) {
+            Key k;
+            k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+            ASSERT_EQ(art->lookup(&k) != nullptr, live.count(key) == 1) << key;
+        }
+        std::vector<Leaf *> result(key_cnt + 1);
+        size_t count = 0;
+        art->lookupRangeReverse(nullptr, nullptr, result.data(), result.size(),
+                                count);
+        ASSERT_EQ(count, live.size());
+    };
+
+    for (auto &key : keys)
+        ASSERT_EQ(insert(key), Tree::OperationResults::Success);
+    size_t peak_inner, peak_arrays;
+    art->countNodes(peak_inner, peak_arrays);
+
+    // keep every 20th key, removed from 4 threads
+    std::set<std::string> live;
+    for (int i = 0; i < key_cnt; i += 20)
+        live.insert(keys[i]);
+    const int nthreads = 4;
+    std::thread *tid[nthreads];
+    for (int t = 0; t < nthreads; t++) {
+        tid[t] = new std::thread(
+            [&](int id) {
+                NVMMgr_ns::register_threadinfo();
+                for (int i = id; i < key_cnt; i += nthreads) {
+                    if (i % 20 != 0)
+                        ASSERT_EQ(remove(keys[i]),
+                                  Tree::OperationResults::Success);
+                }
+                NVMMgr_ns::unregister_threadinfo();
+            },
+            t);
+    }
+    for (int t = 0; t < nthreads; t++) {
+        tid[t]->join();
+        delete tid[t];
+    }
+    check(live);
+
+    size_t inner, arrays;
+    art->countNodes(inner, arrays);
+    std::cout << "[TEST]\tinner nodes " << peak_inner << " -> " << inner
+              << ", leaf arrays " << peak_arrays << " -> " << arrays << "\n";
+    ASSERT_LT(inner * 4, peak_inner);
+    ASSERT_LT(arrays * 4, peak_arrays);
+
+    // the merged arrays split again
+    for (auto &key : keys) {
+        if (live.count(key) == 0)
+            ASSERT_EQ(insert(key), Tree::OperationResults::Success);
+    }
+    live.insert(keys.begin(), keys.end());
+    check(live);
+    for (auto &key : keys)
+        ASSERT_EQ(remove(key), Tree::OperationResults::Success);
+    live.clear();
+    check(live);
+
+    delete art;
+}
+
+// a node with a prefix longer than the stored bytes whose leaf arrays are
+// all empty, as a merge which gave up on a busy lock leaves it
+TEST(TestCorrectness, PM_ART_EMPTY_LONG_PREFIX) {
+
+    std::cout << "[TEST]\tstart to test an empty node with a long prefix\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    const uint8_t prefix[] = "longprefix";
+    const uint32_t prefix_len = 10;
+    auto node = new (NVMMgr_ns::alloc_new_node_from_type(NTypes::N4))
+        N4(prefix_len, prefix, prefix_len);
+    for (uint8_t b : {'a', 'b'})
+        node->insert(b,
+                     N::setLeafArray(new (NVMMgr_ns::alloc_new_node_from_type(
+                         NTypes::LeafArray)) LeafArray(prefix_len + 1)),
+                     false);
+    ASSERT_EQ(N::getAnyChildTid(node), nullptr);
+
+    // the key bytes are not copied by Key, the strings outlive the keys
+    std::vector<std::string> names = {"longprefixa1", "longpreXXXa1",
+                                      "long"};
+    std::vector<Key> keys(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        keys[i].Init((char *)names[i].c_str(), names[i].size(),
+                     (char *)names[i].c_str(), names[i].size());
+    // both keys match the stored bytes, the unknown ones would decide
+    for (Key *k : {&keys[0], &keys[1]}) {
+        uint32_t level = 0;
+        uint8_t nonMatchingKey;
+        Prefix remaining;
+        ASSERT_EQ(Tree::checkPrefixPessimistic(node, k, level, nonMatchingKey,
+                                               remaining),
+                  Tree::CheckPrefixPessimisticResult::Empty);
+        level = 0;
+        ASSERT_EQ(Tree::checkPrefixCompare(node, k, level),
+                  Tree::PCCompareResults::Smaller);
+    }
+    uint32_t level = 0;
+    ASSERT_EQ(Tree::checkPrefixEquals(node, level, &keys[2], &keys[0]),
+              Tree::PCEqualsResults::NoMatch);
+
+    delete art;
+}
+#endif
+
+#ifdef INLINE_LEAF
+TEST(TestCorrectness, PM_ART_INLINE_LEAF) {
+
+    std::cout << "[TEST]\tstart to test leaves inside leaf arrays\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    const int key_cnt = 5000;
+    // every tenth key is too long for an inline leaf
+    auto make_key = [](int i) {
+        std::string key((char *)&i, sizeof(i));
+        std::reverse(key.begin(), key.end());
+        if (i % 10 == 0)
+            key += "-external-leaf-key";
+        return key + "$";
+    };
+    std::map<std::string, std::string> kv;
+    auto put = [&](const std::string &key, const std::string &value,
+                   bool update) {
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)value.data(),
+               value.size());
+        kv[key] = value;
+        return update ? art->update(&k) : art->insert(&k);
+    };
+    auto check = [&](int from, int to) {
+        for (int i = from; i < to; i++) {
+            std::string key = make_key(i);
+            Key k;
+            k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+            Leaf *leaf = art->lookup(&k);
+            if (kv.count(key) == 0) {
+                ASSERT_EQ(leaf, nullptr) << i;
+                continue;
+            }
+            ASSERT_NE(leaf, nullptr) << i;
+            ASSERT_EQ(std::string(leaf->GetValue(), leaf->val_len), kv[key])
+                << i;
+        }
+    };
+
+    // the inline leaves are copied when the arrays split
+    for (int i = 0; i < key_cnt; i++)
+        ASSERT_EQ(put(make_key(i), "v" + std::to_string(i % 1000000), false),
+                  Tree::OperationResults::Success);
+    check(0, key_cnt);
+
+    // the same length is written in place, another one moves the leaf out
+    for (int i = 0; i < key_cnt; i += 3)
+        ASSERT_EQ(put(make_key(i), "u" + std::to_string(i % 1000000) +
+                                       (i % 2 ? "" : "-longer-value"),
+                      true),
+                  Tree::OperationResults::Success);
+    check(0, key_cnt);
+
+    std::string start = make_key(key_cnt / 4), end = make_key(key_cnt / 2);
+    Key start_key, end_key;
+    start_key.Init((char *)start.c_str(), start.size(), nullptr, 0);
+    end_key.Init((char *)end.c_str(), end.size(), nullptr, 0);
+    size_t removed = 0;
+    for (auto it = kv.lower_bound(start); it != kv.lower_bound(end);
+         removed++)
+        it = kv.erase(it);
+    ASSERT_EQ(art->removeRange(&start_key, &end_key), removed);
+    check(0, key_cnt);
+
+    // the arrays merge again when most keys are gone
+    for (int i = 0; i < key_cnt; i++) {
+        if (i % 7 == 0)
+            continue;
+        std::string key = make_key(i);
+        if (kv.erase(key) == 0)
+            continue;
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+        ASSERT_EQ(art->remove(&k), Tree::OperationResults::Success);
+    }
+    check(0, key_cnt);
+
+    delete art;
+}
+#endif
+
+#ifdef LEAF_ARRAY
+TEST(TestCorrectness, PM_ART_LEAF_ARRAY_CONCURRENT) {
+
+    std::cout << "[TEST]\tstart to test concurrent leaf array writes\n";
+    clear_data();
+
+    const int nthreads = 2; // of every kind
+    const int key_cnt = 400;
+    const int iter = 300; // checks of every reader
+    // key i and key i + key_cnt take turns, the value keeps the id of its
+    // key in the high half
+    auto make_key = [](int i) { return "il" + std::to_string(1000 + i); };
+#ifdef INLINE_LEAF
+    ASSERT_TRUE(LeafArray::fitsInline(make_key(0).size(), sizeof(uint64_t)));
+#endif
+
+    Tree *art = new Tree();
+    auto put = [&](int i, uint64_t n, bool update) {
+        std::string key = make_key(i);
+        uint64_t v = ((uint64_t)i << 32) | n;
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), (char *)&v, sizeof(v));
+        return update ? art->update(&k) : art->insert(&k);
+    };
+    // the leaf is only read while the scan holds its epoch, the other
+    // threads run before it is read again
+    auto check = [&](int i, bool &found) {
+        std::string key = make_key(i);
+        Key k;
+        k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+        bool ok = true;
+        found = false;
+        art->scanPrefix(&k, [&](Leaf *leaf) {
+            for (int r = 0; r < 2 && ok; r++) {
+                uint64_t v = 0;
+                memcpy(&v, leaf->GetValue(), sizeof(v));
+                ok = std::string(leaf->GetKey(), leaf->key_len) == key &&
+                     leaf->val_len == sizeof(v) && (v >> 32) == (uint64_t)i;
+                std::this_thread::yield();
+            }
+            found = true;
+            return true;
+        });
+        return ok;
+    };
+    for (int i = 0; i < key_cnt; i++)
+        ASSERT_EQ(put(i, 0, false), Tree::OperationResults::Success);
+
+    // a remove frees a slot, and its inline area, and the insert of the
+    // other key of the pair takes it, under the updates and the readers
+    std::vector<char> second(key_cnt, false);
+    // the writers run until the readers are done
+    std::atomic<int> readers{nthreads};
+    std::thread *tid[nthreads * 3];
+    for (int i = 0; i < nthreads * 3; i++) {
+        tid[i] = new std::thread(
+            [&](int id) {
+                NVMMgr_ns::register_threadinfo();
+                int kind = id / nthreads;
+                for (int j = 0; kind == 2 ? j < iter : readers.load() > 0;
+                     j++) {
+                    int i = (int)(((uint64_t)j * 7919 + id * 101) % key_cnt);
+                    bool found;
+                    if (kind == 0) {
+                        if (i % nthreads != id)
+                            continue;
+                        int from = second[i] ? i + key_cnt : i;
+                        int to = second[i] ? i : i + key_cnt;
+                        std::string key = make_key(from);
+                        Key k;
+                        k.Init((char *)key.c_str(), key.size(), nullptr, 0);
+                        ASSERT_EQ(art->remove(&k),
+                                  Tree::OperationResults::Success);
+                        ASSERT_EQ(put(to, j, false),
+                                  Tree::OperationResults::Success);
+                        second[i] = !second[i];
+                    } else if (kind == 1) {
+                        put(i, j, true);
+                        put(i + key_cnt, j, true);
+                    } else {
+                        EXPECT_TRUE(check(i, found)) << make_key(i);
+                        EXPECT_TRUE(check(i + key_cnt, found))
+                            << make_key(i + key_cnt);
+                    }
+                }
+                if (kind == 2)
+                    readers--;
+                NVMMgr_ns::unregister_threadinfo();
+            },
+            i);
+    }
+    for (int i = 0; i < nthreads * 3; i++) {
+        tid[i]->join();
+        delete tid[i];
+    }
+    for (int i = 0; i < key_cnt; i++) {
+        bool found;
+        ASSERT_TRUE(check(i, found)) << i;
+        ASSERT_EQ(found, !second[i]) << i;
+        ASSERT_TRUE(check(i + key_cnt, found)) << i;
+        ASSERT_EQ(found, (bool)second[i]) << i;
+    }
+
+    delete art;
+}
+#endif
@@ -15,7 +15,9 @@ using namespace NVMMgr_ns;
 
 
 
-inline void clear_data() { system("rm -rf /mnt/pmem0/matianmao/part.data"); }
+inline void clear_data() {
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+}
 
 
 
@@ -136,3 +138,212 @@ TEST(TestEpoch, epoch_based_gc) {
     std::this_thread::sleep_for(duration1);
     close_nvm_mgr();
 }
+
+#ifdef LOG_GARBAGE
+TEST(TestEpoch, garbage_log_recovery) {
+    clear_data();
+    std::cout << "[TEST]\ttest garbage log recovery\n";
+
+    init_nvm_mgr();
+    register_threadinfo();
+
+    uint8_t *prefix = new uint8_t[4];
+    memcpy(prefix, "abc", 3);
+    const int node_num = 3;
+    for (int i = 0; i < node_num; i++) {
+        PART_ns::N4 *n4 = new (alloc_new_node_from_type(PART_ns::NTypes::N4))
+            PART_ns::N4(0, prefix, 3);
+        flush_data((void *)n4, sizeof(PART_ns::N4));
+        MarkNodeGarbage(n4);
+    }
+
+    // crash before the epoch based GC reclaims these nodes
+    unregister_threadinfo();
+    std::chrono::milliseconds duration1(GC_INTERVAL);
+    std::this_thread::sleep_for(duration1);
+    close_nvm_mgr();
+
+    init_nvm_mgr();
+    NVMMgr *mgr = get_nvm_mgr();
+    ASSERT_FALSE(mgr->first_created);
+    ASSERT_EQ(mgr->recovered_garbage.size(), node_num);
+    ASSERT_EQ(mgr->meta_data->threads, 0);
+
+    register_threadinfo();
+    ASSERT_TRUE(mgr->recovered_garbage.empty());
+    ASSERT_EQ(mgr->meta_data->threads, 1);
+
+    thread_info *ti = (thread_info *)get_threadinfo();
+    size_t n4_size = convert_power_two(
+        size_align(get_node_size(PART_ns::NTypes::N4), 64));
+    int id = 0;
+    while ((8UL << id) != n4_size)
+        id++;
+    ASSERT_EQ(ti->free_list->get_freelist_size(id), node_num);
+
+    // reclaimed nodes are not logged any more
+    unregister_threadinfo();
+    std::this_thread::sleep_for(duration1);
+    close_nvm_mgr();
+    init_nvm_mgr();
+    ASSERT_TRUE(get_nvm_mgr()->recovered_garbage.empty());
+    close_nvm_mgr();
+    delete[] prefix;
+}
+
+// every node of the file can be logged, the leaves at its end as well
+TEST(TestEpoch, garbage_log_reach) {
+    std::cout << "[TEST]\ttest garbage log reach\n";
+    char *area = new char[4032];
+    GarbageLog *log = (GarbageLog *)area;
+    log->reset();
+
+    const uint64_t last = NVMMgr::start_addr + NVMMgr::filesize - 64;
+    std::vector<uint64_t> nodes = {NVMMgr::data_block_start,
+                                   NVMMgr::start_addr + (100LL << 30), last};
+#ifdef COMPACT_LEAF
+    nodes.push_back(last + 16);
+#endif
+    for (size_t i = 0; i < nodes.size(); i++)
+        ASSERT_TRUE(log->append(i, (void *)nodes[i], false));
+    ASSERT_FALSE(log->append(nodes.size(), (void *)(last + 64), false));
+    // a subtree root anywhere in the file as well
+    ASSERT_TRUE(log->append(nodes.size(), (void *)last, true));
+
+    std::vector<uint64_t> collected, subtrees;
+    log->collect(collected, subtrees);
+    ASSERT_EQ(collected, nodes);
+    ASSERT_EQ(subtrees, std::vector<uint64_t>{last});
+    delete[] area;
+}
+
+#ifdef LEAF_ARRAY
+// a removed range takes a few slots of the log however many leaves it has,
+// and its subtrees are reclaimed after a crash
+TEST(TestEpoch, garbage_log_subtree) {
+    clear_data();
+    std::cout << "[TEST]\ttest garbage log of removed subtrees\n";
+
+    const int key_num = 3000;
+    char buf[32];
+    PART_ns::Key k;
+    PART_ns::Tree *art = new PART_ns::Tree();
+    for (int i = 0; i < key_num; i++) {
+        for (const char *p : {"gsub", "keep"}) {
+            snprintf(buf, sizeof(buf), "%s%05d", p, i);
+            k.Init(buf, strlen(buf), buf, strlen(buf));
+            ASSERT_EQ(art->insert(&k),
+                      PART_ns::Tree::OperationResults::Success);
+        }
+    }
+
+    thread_info *ti = (thread_info *)get_threadinfo();
+    uint64_t tail = ti->md->log_tail;
+    PART_ns::Key start, end;
+    start.Init((char *)"gsub", 4, nullptr, 0);
+    end.Init((char *)"gsuc", 4, nullptr, 0);
+    ASSERT_EQ(art->removeRange(&start, &end), (std::size_t)key_num);
+    ASSERT_LT(ti->md->log_tail - tail, 16UL);
+
+    // crash before the epoch based GC reclaims the subtrees
+    delete art;
+    std::chrono::milliseconds duration1(GC_INTERVAL);
+    std::this_thread::sleep_for(duration1);
+
+    init_nvm_mgr();
+    NVMMgr *mgr = get_nvm_mgr();
+    ASSERT_GE(mgr->recovered_subtrees.size(), 1UL);
+    register_threadinfo();
+    ASSERT_TRUE(mgr->recovered_subtrees.empty());
+    unregister_threadinfo();
+    std::this_thread::sleep_for(duration1);
+    close_nvm_mgr();
+
+    // the memory of the subtrees is used again
+    art = new PART_ns::Tree();
+    for (int i = 0; i < key_num; i++) {
+        snprintf(buf, sizeof(buf), "keep%05d", i);
+        k.Init(buf, strlen(buf), buf, strlen(buf));
+        PART_ns::Leaf *ret = art->lookup(&k);
+        ASSERT_NE(ret, nullptr) << buf;
+        ASSERT_EQ(std::string(ret->GetValue(), ret->val_len), buf);
+        snprintf(buf, sizeof(buf), "gsub%05d", i);
+        k.Init(buf, strlen(buf), buf, strlen(buf));
+        ASSERT_EQ(art->lookup(&k), nullptr);
+        ASSERT_EQ(art->insert(&k), PART_ns::Tree::OperationResults::Success);
+    }
+    for (int i = 0; i < key_num; i++) {
+        for (const char *p : {"gsub", "keep"}) {
+            snprintf(buf, sizeof(buf), "%s%05d", p, i);
+            k.Init(buf, strlen(buf), buf, strlen(buf));
+            PART_ns::Leaf *ret = art->lookup(&k);
+            ASSERT_NE(ret, nullptr) << buf;
+            ASSERT_EQ(std::string(ret->GetValue(), ret->val_len), buf);
+        }
+    }
+    delete art;
+}
+#endif
+#endif
+
+#ifdef QSBR
+TEST(TestEpoch, qsbr_gc) {
+    clear_data();
+    std::cout << "[TEST]\ttest quiescent state based reclamation\n";
+
+    init_nvm_mgr();
+    register_threadinfo();
+    thread_info *ti = (thread_info *)get_threadinfo();
+
+    // another online thread which does not announce quiescent states
+    volatile bool online = false, offline = false, finish = false;
+    std::thread reader([&]() {
+        register_threadinfo();
+        online = true;
+        while (!offline)
+            std::this_thread::yield();
+        ThreadOffline();
+        while (!finish)
+            std::this_thread::yield();
+        unregister_threadinfo();
+    });
+    while (!online)
+        std::this_thread::yield();
+
+    uint8_t *prefix = new uint8_t[4];
+    memcpy(prefix, "abc", 3);
+    const int node_num = 3;
+    for (int i = 0; i < node_num; i++) {
+        PART_ns::N4 *n4 = new (alloc_new_node_from_type(PART_ns::NTypes::N4))
+            PART_ns::N4(0, prefix, 3);
+        MarkNodeGarbage(n4);
+    }
+    size_t n4_size = convert_power_two(
+        size_align(get_node_size(PART_ns::NTypes::N4), 64));
+    int id = 0;
+    while ((8UL << id) != n4_size)
+        id++;
+    int free_num = ti->free_list->get_freelist_size(id);
+
+    // the reader may still hold these nodes
+    std::chrono::milliseconds duration1(GC_INTERVAL * 2);
+    std::this_thread::sleep_for(duration1);
+    QuiescentState();
+    ti->PerformGC();
+    ASSERT_EQ(ti->free_list->get_freelist_size(id), free_num);
+
+    // an offline thread does not hold back the grace period
+    offline = true;
+    std::this_thread::sleep_for(duration1);
+    QuiescentState();
+    ti->PerformGC();
+    ASSERT_EQ(ti->free_list->get_freelist_size(id), free_num + node_num);
+
+    finish = true;
+    reader.join();
+    unregister_threadinfo();
+    std::this_thread::sleep_for(duration1);
+    close_nvm_mgr();
+    delete[] prefix;
+}
+#endif
@@ -0,0 +1,135 @@
+#include "KeyCodec.h"
+#include "N.h"
+#include "Tree.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace PART_ns;
+
+inline void clear_data() {
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+}
+
+static std::string bytes_of(uint64_t ordered) {
+    return std::string((char *)&ordered, sizeof(ordered));
+}
+
+TEST(KeyCodecTest, numbers_keep_order) {
+    std::vector<uint64_t> u = {0, 1, 255, 256, 65535, 1ull << 32,
+                               std::numeric_limits<uint64_t>::max()};
+    for (size_t i = 0; i + 1 < u.size(); i++)
+        ASSERT_LT(bytes_of(KeyCodec::order_u64(u[i])),
+                  bytes_of(KeyCodec::order_u64(u[i + 1])));
+
+    std::vector<int64_t> s = {std::numeric_limits<int64_t>::min(), -65536, -1,
+                              0, 1, 255, std::numeric_limits<int64_t>::max()};
+    for (size_t i = 0; i + 1 < s.size(); i++)
+        ASSERT_LT(bytes_of(KeyCodec::order_i64(s[i])),
+                  bytes_of(KeyCodec::order_i64(s[i + 1])));
+
+    std::vector<double> d = {-std::numeric_limits<double>::infinity(),
+                             -1e300, -2.5, -1e-300, -0.0, 0.0, 1e-300, 2.5,
+                             1e300, std::numeric_limits<double>::infinity()};
+    for (size_t i = 0; i + 1 < d.size(); i++)
+        ASSERT_LT(bytes_of(KeyCodec::order_double(d[i])),
+                  bytes_of(KeyCodec::order_double(d[i + 1])));
+
+    for (uint64_t v : u)
+        ASSERT_EQ(KeyCodec::decode_u64(bytes_of(KeyCodec::order_u64(v)).data()),
+                  v);
+    for (int64_t v : s)
+        ASSERT_EQ(KeyCodec::decode_i64(bytes_of(KeyCodec::order_i64(v)).data()),
+                  v);
+    for (double v : d)
+        ASSERT_EQ(
+            KeyCodec::decode_double(bytes_of(KeyCodec::order_double(v)).data()),
+            v);
+}
+
+TEST(KeyCodecTest, composite_round_trip) {
+    // (string, int64) tuples, the strings contain zeros and prefixes
+    std::vector<std::string> names = {"", std::string("a\0", 2), "a",
+                                      std::string("a\0b", 3), "ab", "b"};
+    std::sort(names.begin(), names.end());
+    std::vector<int64_t> ids = {-7, 0, 42};
+
+    std::vector<std::string> encoded;
+    for (auto &name : names) {
+        for (int64_t id : ids) {
+            uint8_t buf[64];
+            KeyCodec::Encoder e(buf, sizeof(buf));
+            e.str(name).i64(id);
+            ASSERT_TRUE(e.ok());
+            encoded.push_back(std::string(e.data(), e.size()));
+
+            KeyCodec::Decoder dec(buf, e.size());
+            std::string n;
+            int64_t i;
+            ASSERT_TRUE(dec.str(n));
+            ASSERT_TRUE(dec.i64(i));
+            ASSERT_TRUE(dec.done());
+            ASSERT_EQ(n, name);
+            ASSERT_EQ(i, id);
+        }
+    }
+    // the tuples were generated in order, and no key is a prefix of another
+    for (size_t i = 0; i + 1 < encoded.size(); i++) {
+        ASSERT_LT(encoded[i], encoded[i + 1]);
+        ASSERT_NE(encoded[i + 1].compare(0, encoded[i].size(), encoded[i]), 0);
+    }
+
+    uint8_t small[10];
+    KeyCodec::Encoder e(small, sizeof(small));
+    e.u64(1).u64(2);
+    ASSERT_FALSE(e.ok());
+    ASSERT_EQ(e.size(), 8);
+}
+
+TEST(KeyCodecTest, integer_range_scan) {
+    std::cout << "[TEST]\tstart to test integer range scan\n";
+    clear_data();
+
+    Tree *art = new Tree();
+    const uint64_t key_cnt = 3000;
+    char value[8] = "value";
+    for (uint64_t i = 0; i < key_cnt; i++) {
+        uint64_t ik = KeyCodec::order_u64(i * 3);
+        Key k;
+        k.Init((char *)&ik, sizeof(ik), value, sizeof(value));
+        ASSERT_EQ(art->insert(&k), Tree::OperationResults::Success);
+    }
+
+    // 255..766 crosses the low byte, which little endian keys get wrong
+    uint64_t start = 255, end = 767;
+    uint64_t sk = KeyCodec::order_u64(start), ek = KeyCodec::order_u64(end);
+    Key start_key, end_key;
+    start_key.Init((char *)&sk, sizeof(sk), value, sizeof(value));
+    end_key.Init((char *)&ek, sizeof(ek), value, sizeof(value));
+
+    const size_t scan_length = 1000;
+    std::vector<Leaf *> result(scan_length);
+    size_t result_count = 0;
+    Key *toContinue = nullptr;
+    // true would mean the result is cut off
+    ASSERT_FALSE(art->lookupRange(&start_key, &end_key, toContinue,
+                                  result.data(), scan_length, result_count));
+
+    std::vector<uint64_t> found;
+    for (size_t i = 0; i < result_count; i++) {
+        ASSERT_EQ(result[i]->key_len, sizeof(uint64_t));
+        found.push_back(KeyCodec::decode_u64(result[i]->GetKey()));
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<uint64_t> expected;
+    for (uint64_t v = start; v < end; v++)
+        if (v % 3 == 0)
+            expected.push_back(v);
+    ASSERT_EQ(found, expected);
+
+    delete art;
+}
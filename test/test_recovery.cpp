@@ -69,3 +69,105 @@
 //    unregister_threadinfo();
 //    close_nvm_mgr();
 //}
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Tree.h"
+#include "nvm_mgr.h"
+
+#ifdef INSTANT_RESTART
+TEST(TestRecovery, background_recovery) {
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+    std::cout << "[TEST]\tstart to test background recovery\n";
+
+    const int key_num = 100000;
+    std::vector<std::string> keys;
+    char buf[32];
+    for (int i = 0; i < key_num; i++) {
+        // keys must not be a prefix of each other
+        snprintf(buf, sizeof(buf), "key%08d", i * 7919 % key_num);
+        keys.push_back(buf);
+    }
+
+    auto *k = new PART_ns::Key();
+    PART_ns::Tree *art = new PART_ns::Tree();
+    for (auto &s : keys) {
+        k->Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+        ASSERT_EQ(art->insert(k), PART_ns::Tree::OperationResults::Success);
+    }
+    delete art;
+
+    // restart and repair the nodes in background while serving lookups
+    art = new PART_ns::Tree();
+    art->startRecovery(2);
+    for (int i = 0; i < key_num; i += 2) {
+        k->Init((char *)keys[i].c_str(), keys[i].size(),
+                (char *)keys[i].c_str(), keys[i].size());
+        PART_ns::Leaf *ret = art->lookup(k);
+        ASSERT_NE(ret, nullptr);
+        ASSERT_TRUE(ret->checkKey(k));
+    }
+    ASSERT_TRUE(art->waitRecovery());
+    ASSERT_FALSE(art->waitRecovery());
+
+    for (auto &s : keys) {
+        k->Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+        PART_ns::Leaf *ret = art->lookup(k);
+        ASSERT_NE(ret, nullptr);
+        ASSERT_EQ(std::string(ret->GetValue(), ret->val_len), s);
+    }
+    // a scan repairs the nodes it streams
+    char empty = 0;
+    PART_ns::Key prefix;
+    prefix.Init(&empty, 0, nullptr, 0);
+    ASSERT_EQ(art->scanPrefix(&prefix, [](PART_ns::Leaf *) { return true; }),
+              (std::size_t)key_num);
+    std::string s = "key_new_key";
+    k->Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+    ASSERT_EQ(art->insert(k), PART_ns::Tree::OperationResults::Success);
+
+    delete art;
+    delete k;
+}
+
+// the slots of a repaired N4/N16/N48 are compacted up to its last child, an
+// insert after the restart takes the next slot
+TEST(TestRecovery, repaired_node_children) {
+    system((std::string("rm -rf ") + nvm_dir + "part.data").c_str());
+    std::cout << "[TEST]\tstart to test children of repaired nodes\n";
+
+    // 10 children of one N16, more keys than one leaf array takes
+    std::vector<std::string> keys;
+    char buf[32];
+    for (int d = 0; d < 10; d++)
+        for (int i = 0; i < 20; i++) {
+            snprintf(buf, sizeof(buf), "rc%d-%02d", d, i);
+            keys.push_back(buf);
+        }
+
+    PART_ns::Key k;
+    PART_ns::Tree *art = new PART_ns::Tree();
+    for (auto &s : keys) {
+        k.Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+        ASSERT_EQ(art->insert(&k), PART_ns::Tree::OperationResults::Success);
+    }
+    delete art;
+
+    art = new PART_ns::Tree();
+    std::string s = "rcZ-00";
+    k.Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+    ASSERT_EQ(art->insert(&k), PART_ns::Tree::OperationResults::Success);
+    keys.push_back(s);
+    for (auto &s : keys) {
+        k.Init((char *)s.c_str(), s.size(), (char *)s.c_str(), s.size());
+        PART_ns::Leaf *ret = art->lookup(&k);
+        ASSERT_NE(ret, nullptr) << s;
+        ASSERT_EQ(std::string(ret->GetValue(), ret->val_len), s);
+    }
+
+    delete art;
+}
+#endif